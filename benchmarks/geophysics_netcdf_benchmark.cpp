@@ -0,0 +1,251 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+// Throughput benchmarks of the main I/O paths of the library.
+// A synthetic survey (see GSyntheticSurvey) is written once for each chunking/compression setting
+// in the matrix, then each path is timed and reported in MB/s and samples/s.
+//
+// Usage: geophysics_netcdf_benchmark [workdir] [nlines] [samplesperline] [nbands] [repeats]
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include "geophysics_netcdf_synthetic.hpp"
+
+using namespace netCDF;
+using namespace GeophysicsNetCDF;
+
+class cSetting {
+public:
+	std::string name;
+	size_t chunkrows;//0 for contiguous
+	int deflatelevel;//0 for no compression
+};
+
+class cResult {
+public:
+	std::string setting;
+	std::string test;
+	double seconds = 0.0;
+	double bytes = 0.0;
+	double samples = 0.0;
+};
+
+class cBenchmark {
+
+private:
+
+	std::string WorkDir;
+	size_t NLines;
+	size_t NSamplesPerLine;
+	size_t NBands;
+	size_t Repeats;
+	std::vector<cResult> Results;
+
+	static double now() {
+		using namespace std::chrono;
+		return duration<double>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	//Best of Repeats runs, f returns the number of bytes and samples processed
+	template<typename F>
+	void measure(const cSetting& s, const std::string& test, F f) {
+		cResult r;
+		r.setting = s.name;
+		r.test = test;
+		r.seconds = std::numeric_limits<double>::max();
+		for (size_t k = 0; k < Repeats; k++) {
+			double bytes = 0.0, samples = 0.0;
+			const double t0 = now();
+			f(bytes, samples);
+			const double dt = now() - t0;
+			if (dt < r.seconds) {
+				r.seconds = dt;
+				r.bytes = bytes;
+				r.samples = samples;
+			}
+		}
+		report(r);
+		Results.push_back(r);
+	}
+
+	static void report(const cResult& r) {
+		const double t = std::max(r.seconds, 1e-9);
+		std::printf("%-16s %-28s %10.4f s %10.1f MB/s %14.0f samples/s\n",
+			r.setting.c_str(), r.test.c_str(), r.seconds, r.bytes / t / 1048576.0, r.samples / t);
+		std::fflush(stdout);
+	}
+
+	std::string path(const cSetting& s, const std::string& suffix) const {
+		return WorkDir + "/benchmark_" + s.name + suffix;
+	}
+
+	void create(const cSetting& s) {
+		cSyntheticOptions o;
+		o.nlines = NLines;
+		o.meansamples = NSamplesPerLine;
+		o.lengthspread = 0.0;
+		o.nbands = NBands;
+		o.chunkrows = s.chunkrows;
+		o.deflatelevel = s.deflatelevel;
+		GSyntheticSurvey(o).write(path(s, ".nc"));
+	}
+
+	//Bytes held by all the sample variables of a file
+	static double sample_bytes(const GFile& f) {
+		double bytes = 0.0;
+		auto vm = f.getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			const NcVar& v = vit->second;
+			if (f.isSampleVar(v) == false) continue;
+			double n = (double)v.getType().getSize();
+			for (const NcDim& d : v.getDims()) n *= (double)d.getSize();
+			bytes += n;
+		}
+		return bytes;
+	}
+
+	void run(const cSetting& s) {
+		create(s);
+		const std::string ncpath = path(s, ".nc");
+		const double ns = (double)(NLines * NSamplesPerLine);
+
+		measure(s, "open", [&](double& bytes, double& samples) {
+			GFile f(ncpath, NcFile::read);
+			samples = (double)f.ntotalsamples();
+		});
+
+		GFile f(ncpath, NcFile::read);
+		const double allbytes = sample_bytes(f);
+
+		measure(s, "getLine 1-D", [&](double& bytes, double& samples) {
+			GSampleVar v = f.getSampleVar("height");
+			std::vector<float> vals;
+			for (size_t li = 0; li < f.nlines(); li++) v.getLine(li, vals);
+			bytes = ns * sizeof(float);
+			samples = ns;
+		});
+
+		measure(s, "getLine multiband", [&](double& bytes, double& samples) {
+			GSampleVar v = f.getSampleVar("em");
+			std::vector<float> vals;
+			for (size_t li = 0; li < f.nlines(); li++) v.getLine(li, vals);
+			bytes = ns * NBands * sizeof(float);
+			samples = ns;
+		});
+
+		measure(s, "getLineBands late 1/3", [&](double& bytes, double& samples) {
+			GSampleVar v = f.getSampleVar("em");
+			const size_t nb = std::max((size_t)1, NBands / 3);
+			std::vector<float> vals;
+			for (size_t li = 0; li < f.nlines(); li++) v.getLineBands(li, NBands - nb, nb, vals);
+			bytes = ns * nb * sizeof(float);
+			samples = ns;
+		});
+
+		measure(s, "getLineStrided 1/100", [&](double& bytes, double& samples) {
+			GSampleVar v = f.getSampleVar("height");
+			std::vector<float> vals;
+			size_t n = 0;
+			for (size_t li = 0; li < f.nlines(); li++) {
+				v.getLineStrided(li, 100, vals);
+				n += vals.size();
+			}
+			bytes = (double)(n * sizeof(float));
+			samples = (double)n;
+		});
+
+		measure(s, "getLineDecimated 1000", [&](double& bytes, double& samples) {
+			GSampleVar v = f.getSampleVar("mag");
+			std::vector<double> vmin, vmax;
+			for (size_t li = 0; li < f.nlines(); li++) v.getLineDecimated(li, 1000, vmin, vmax);
+			bytes = ns * sizeof(float);
+			samples = ns;
+		});
+
+		measure(s, "getDataByLineIndex", [&](double& bytes, double& samples) {
+			std::vector<double> vals;
+			for (size_t li = 0; li < f.nlines(); li++) f.getDataByLineIndex("easting", li, vals);
+			bytes = ns * sizeof(double);
+			samples = ns;
+		});
+
+		measure(s, "getDataByPointIndex", [&](double& bytes, double& samples) {
+			//A strided sweep, as done when sampling points at random
+			const size_t npoints = std::min((size_t)10000, f.ntotalsamples());
+			const size_t step = std::max((size_t)1, f.ntotalsamples() / std::max((size_t)1, npoints));
+			std::vector<float> vals;
+			for (size_t k = 0; k < npoints; k++) f.getDataByPointIndex("em", k * step, vals);
+			bytes = (double)(npoints * NBands * sizeof(float));
+			samples = (double)npoints;
+		});
+
+		measure(s, "minmax", [&](double& bytes, double& samples) {
+			double vmin, vmax;
+			f.minmax("height", vmin, vmax);
+			bytes = ns * sizeof(float);
+			samples = ns;
+		});
+
+		measure(s, "subsample (copy_var)", [&](double& bytes, double& samples) {
+			GFile out(path(s, "_subsample.nc"), NcFile::replace);
+			out.subsample(f, 2, {}, {});
+			bytes = allbytes;
+			samples = ns;
+		});
+
+		measure(s, "export_ASEGGDF2", [&](double& bytes, double& samples) {
+			//Silence the per-line progress messages
+			std::ostringstream sink;
+			std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+			f.export_ASEGGDF2(path(s, ".dat"), path(s, ".dfn"));
+			std::cout.rdbuf(old);
+			bytes = allbytes;
+			samples = ns;
+		});
+	}
+
+public:
+
+	cBenchmark(const std::string& workdir, const size_t nlines, const size_t nsamplesperline, const size_t nbands, const size_t repeats)
+		: WorkDir(workdir), NLines(nlines), NSamplesPerLine(nsamplesperline), NBands(nbands), Repeats(std::max((size_t)1, repeats))
+	{}
+
+	void run() {
+		const std::vector<cSetting> matrix = {
+			{ "contiguous", 0, 0 },
+			{ "chunk1k", 1024, 0 },
+			{ "chunk1k_z1", 1024, 1 },
+			{ "chunk16k", 16384, 0 },
+			{ "chunk16k_z1", 16384, 1 },
+			{ "chunk16k_z6", 16384, 6 }
+		};
+		std::printf("lines=%zu samplesperline=%zu bands=%zu repeats=%zu\n", NLines, NSamplesPerLine, NBands, Repeats);
+		for (const cSetting& s : matrix) run(s);
+	}
+};
+
+int main(int argc, char** argv)
+{
+	const std::string workdir = argc > 1 ? argv[1] : ".";
+	const size_t nlines = argc > 2 ? (size_t)std::atol(argv[2]) : 200;
+	const size_t nsamples = argc > 3 ? (size_t)std::atol(argv[3]) : 5000;
+	const size_t nbands = argc > 4 ? (size_t)std::atol(argv[4]) : 30;
+	const size_t repeats = argc > 5 ? (size_t)std::atol(argv[5]) : 3;
+
+	try {
+		cBenchmark b(workdir, nlines, nsamples, nbands, repeats);
+		b.run();
+	}
+	catch (const std::exception& e) {
+		std::printf("%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+// Correctness checks of library behaviour that the benchmarks do not cover.
+// Each check writes small files to workdir, reports ok or FAILED, and the exit
+// status is the number of failed checks.
+//
+// Usage: geophysics_netcdf_check [workdir]
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include "geophysics_netcdf_synthetic.hpp"
+
+using namespace netCDF;
+using namespace GeophysicsNetCDF;
+
+class cCheck {
+
+private:
+
+	std::string WorkDir;
+	size_t NFailed = 0;
+
+	[[noreturn]] static void fail(const std::string& what) {
+		std::string msg = _SRC_ + strprint("\n%s\n", what.c_str());
+		throw(std::exception(msg.c_str()));
+	}
+
+	void run(const std::string& name, std::function<void()> f) {
+		try {
+			f();
+			std::printf("%-40s ok\n", name.c_str());
+		}
+		catch (const std::exception& e) {
+			std::printf("%-40s FAILED %s\n", name.c_str(), e.what());
+			NFailed++;
+		}
+		std::fflush(stdout);
+	}
+
+	//Line pruning in select() must not change the selection, including where a null sample
+	//makes a predicate true, "!(mag > -1e9)" selects exactly the null mag samples
+	void select_with_nulls() {
+		cSyntheticOptions o;
+		o.nlines = 20;
+		o.meansamples = 2000;
+		o.nbands = 1;
+		o.nullfraction = 0.05;
+		const std::string ncpath = WorkDir + "/check_select_nulls.nc";
+		GSyntheticSurvey(o).write(ncpath);
+
+		const std::vector<std::string> predicates = { "!(mag > -1e9)", "mag > -1e9", "!(mag < 0) && height > 0" };
+		std::vector<size_t> expected;
+		{
+			GFile f(ncpath, NcFile::read);
+			for (const std::string& p : predicates) expected.push_back(f.select(p).nselected());
+		}
+		if (expected[0] == 0) fail("The survey has no null mag samples");
+
+		GFile f(ncpath, NcFile::write);
+		f.addLineSummaries("mag");
+		f.addLineSummaries("height");
+		for (size_t k = 0; k < predicates.size(); k++) {
+			const size_t n = f.select(predicates[k]).nselected();
+			if (n != expected[k]) {
+				fail(strprint("select(\"%s\") with line summaries selected %zu samples, expected %zu", predicates[k].c_str(), n, expected[k]));
+			}
+		}
+	}
+
+	//An int64 variable must read through minmax and export, with values beyond the
+	//range of int intact and nulls written as the export null value
+	void int64_minmax_and_export() {
+		const std::string ncpath = WorkDir + "/check_int64.nc";
+		const long long big = (1LL << 40) + 1;
+		{
+			GFile f(ncpath, NcFile::replace);
+			f.InitialiseNew(std::vector<size_t>{ 100, 200 }, std::vector<size_t>{ 3, 2 });
+			if (f.addSampleVar("count", ncInt64) == false) fail("Could not add the int64 variable");
+			GSampleVar v = f.getSampleVar("count");
+			const long long null = v.missingvalue(0LL);
+			v.putLine(0, std::vector<long long>{ big, null, -5 });
+			v.putLine(1, std::vector<long long>{ null, 7 });
+		}
+
+		GFile f(ncpath, NcFile::read);
+		double vmin, vmax;
+		f.minmax("count", vmin, vmax);
+		if (vmin != -5.0 || vmax != (double)big) {
+			fail(strprint("minmax gave %lf %lf, expected -5 %lld", vmin, vmax, big));
+		}
+
+		//Only the first sample of each line is exported for these short lines
+		const std::string datpath = WorkDir + "/check_int64.dat";
+		f.export_ASEGGDF2(datpath, WorkDir + "/check_int64.dfn");
+		std::ifstream in(datpath);
+		std::stringstream ss;
+		ss << in.rdbuf();
+		const std::string dat = ss.str();
+		if (dat.find(std::to_string(big)) == std::string::npos) fail("The exported file does not have the int64 value " + std::to_string(big));
+		if (dat.find("-999") == std::string::npos) fail("The exported file does not have the null int64 value as -999");
+	}
+
+public:
+
+	cCheck(const std::string& workdir) : WorkDir(workdir) {}
+
+	size_t run() {
+		run("select with nulls and line summaries", [this] { select_with_nulls(); });
+		run("int64 minmax and export", [this] { int64_minmax_and_export(); });
+		return NFailed;
+	}
+};
+
+int main(int argc, char** argv)
+{
+	const std::string workdir = argc > 1 ? argv[1] : ".";
+	cCheck c(workdir);
+	const size_t nfailed = c.run();
+	std::printf("%zu failed\n", nfailed);
+	return (int)nfailed;
+}
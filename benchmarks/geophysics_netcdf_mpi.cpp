@@ -0,0 +1,120 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+// Parallel I/O example and benchmark. The samples are split into one balanced piece per
+// rank (see GFile::partition()), every rank writes its piece collectively into one
+// shared file, then reads it back independently and checks the values, timing both phases.
+//
+// Usage: mpirun -np 4 geophysics_netcdf_mpi [workdir] [nlines] [samplesperline] [nbands]
+
+#include <cstdio>
+#include "geophysics_netcdf.hpp"
+
+using namespace netCDF;
+using namespace GeophysicsNetCDF;
+
+//Value of a sample/band, exactly representable as float
+static float value(const size_t li, const size_t si, const size_t bi) {
+	return (float)(li * 100 + bi) + 0.25f * (float)(si % 4);
+}
+
+int main(int argc, char** argv)
+{
+	MPI_Init(&argc, &argv);
+	int rank, nranks;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+	const std::string workdir = argc > 1 ? argv[1] : ".";
+	const size_t nlines = argc > 2 ? (size_t)std::atol(argv[2]) : 200;
+	const size_t nsamples = argc > 3 ? (size_t)std::atol(argv[3]) : 5000;
+	const size_t nbands = argc > 4 ? (size_t)std::atol(argv[4]) : 30;
+	const std::string path = workdir + "/benchmark_mpi.nc";
+
+	int status = 0;
+	try {
+		std::vector<unsigned int> linenumbers(nlines);
+		std::vector<unsigned int> counts(nlines, (unsigned int)nsamples);
+		for (size_t li = 0; li < nlines; li++) linenumbers[li] = (unsigned int)(1000 + li);
+
+		//Write, defining the file is collective so every rank makes the same calls
+		MPI_Barrier(MPI_COMM_WORLD);
+		double t0 = MPI_Wtime();
+		{
+			GFile f(MPI_COMM_WORLD, path, NcFile::replace);
+			f.InitialiseNew(linenumbers, counts);
+			NcDim band = f.addDim("em_window", nbands);
+			f.addSampleVar("em", ncFloat, band);
+			GSampleVar v = f.getSampleVar("em");
+			v.set_collective(true);
+
+			//Every rank makes the same number of collective calls
+			const GPartition part = f.partition((size_t)nranks, true)[(size_t)rank];
+			unsigned long long nseg = part.nsegments(), maxseg = 0;
+			MPI_Allreduce(&nseg, &maxseg, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+
+			std::vector<float> vals;
+			for (size_t k = 0; k < (size_t)maxseg; k++) {
+				//putSegment() makes no call for a line with no samples
+				if (k >= part.nsegments() || part.Segments[k].count == 0) {
+					v.putNothing();
+					continue;
+				}
+				const GSegment& seg = part.Segments[k];
+				vals.resize(seg.count * nbands);
+				for (size_t si = 0; si < seg.count; si++) {
+					for (size_t bi = 0; bi < nbands; bi++) vals[si * nbands + bi] = value(seg.lineindex, seg.offset + si, bi);
+				}
+				v.putSegment(seg, vals);
+			}
+		}
+		const double twrite = MPI_Wtime() - t0;
+
+		//Read back independently and check
+		MPI_Barrier(MPI_COMM_WORLD);
+		t0 = MPI_Wtime();
+		long long nbad = 0;
+		{
+			GFile f(MPI_COMM_WORLD, path, NcFile::read);
+			GSampleVar v = f.getSampleVar("em");
+			const GPartition part = f.partition((size_t)nranks, true)[(size_t)rank];
+			std::vector<float> vals;
+			for (const GSegment& seg : part.Segments) {
+				v.getSegment(seg, vals);
+				for (size_t si = 0; si < seg.count; si++) {
+					for (size_t bi = 0; bi < nbands; bi++) {
+						if (vals[si * nbands + bi] != value(seg.lineindex, seg.offset + si, bi)) nbad++;
+					}
+				}
+			}
+		}
+		const double tread = MPI_Wtime() - t0;
+
+		double tw = 0.0, tr = 0.0;
+		long long totalbad = 0;
+		MPI_Reduce(&twrite, &tw, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&tread, &tr, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&nbad, &totalbad, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+		if (rank == 0) {
+			const double mb = (double)(nlines * nsamples * nbands * sizeof(float)) / 1048576.0;
+			std::printf("ranks=%d lines=%zu samplesperline=%zu bands=%zu\n", nranks, nlines, nsamples, nbands);
+			std::printf("%-16s %10.4f s %10.1f MB/s\n", "collective write", tw, mb / std::max(tw, 1e-9));
+			std::printf("%-16s %10.4f s %10.1f MB/s\n", "independent read", tr, mb / std::max(tr, 1e-9));
+			std::printf("mismatched values %lld\n", totalbad);
+			if (totalbad != 0) status = 1;
+		}
+	}
+	catch (const std::exception& e) {
+		std::printf("rank %d: %s\n", rank, e.what());
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	MPI_Finalize();
+	return status;
+}
@@ -0,0 +1,75 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+// Writes a synthetic survey for scale testing, see GSyntheticSurvey.
+//
+// Usage: geophysics_netcdf_synthetic [options] output.nc
+//   -lines n        number of lines (100)
+//   -samples n      mean samples per line (10000)
+//   -spread f       line length spread as a fraction of the mean (0.3)
+//   -bands n        bands of the em variable (30)
+//   -type t         data type: short, int, float or double (float)
+//   -nulls f        fraction of null data samples (0)
+//   -chunk n        chunk size of the point dimension, 0 for contiguous (16384)
+//   -deflate n      compression level 0-9 (0)
+//   -seed n         random seed (1)
+
+#include <cstdio>
+#include <cstring>
+#include "geophysics_netcdf_synthetic.hpp"
+
+using namespace netCDF;
+using namespace GeophysicsNetCDF;
+
+static NcType parse_type(const std::string& s) {
+	if (s == "short") return ncShort;
+	if (s == "int") return ncInt;
+	if (s == "float") return ncFloat;
+	if (s == "double") return ncDouble;
+	std::string msg = _SRC_ + strprint("\nUnknown data type (%s)\n", s.c_str());
+	throw(std::exception(msg.c_str()));
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		cSyntheticOptions o;
+		std::string path;
+		for (int i = 1; i < argc; i++) {
+			const std::string a = argv[i];
+			const bool hasvalue = i + 1 < argc;
+			if (a == "-lines" && hasvalue) o.nlines = (size_t)std::atoll(argv[++i]);
+			else if (a == "-samples" && hasvalue) o.meansamples = (size_t)std::atoll(argv[++i]);
+			else if (a == "-spread" && hasvalue) o.lengthspread = std::atof(argv[++i]);
+			else if (a == "-bands" && hasvalue) o.nbands = (size_t)std::atoll(argv[++i]);
+			else if (a == "-type" && hasvalue) o.datatype = parse_type(argv[++i]);
+			else if (a == "-nulls" && hasvalue) o.nullfraction = std::atof(argv[++i]);
+			else if (a == "-chunk" && hasvalue) o.chunkrows = (size_t)std::atoll(argv[++i]);
+			else if (a == "-deflate" && hasvalue) o.deflatelevel = std::atoi(argv[++i]);
+			else if (a == "-seed" && hasvalue) o.seed = (uint64_t)std::strtoull(argv[++i], nullptr, 10);
+			else if (a.size() && a[0] != '-') path = a;
+			else {
+				std::printf("Unknown option %s\n", a.c_str());
+				return 1;
+			}
+		}
+
+		if (path.size() == 0) {
+			std::printf("Usage: %s [-lines n] [-samples n] [-spread f] [-bands n] [-type t] [-nulls f] [-chunk n] [-deflate n] [-seed n] output.nc\n", argv[0]);
+			return 1;
+		}
+
+		GSyntheticSurvey s(o);
+		s.write(path);
+	}
+	catch (const std::exception& e) {
+		std::printf("%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -12,10 +12,15 @@ Author: Ross C. Brodie, Geoscience Australia.
 #include <cstdarg>
 #include <stdexcept>
 #include <map>
+#include <set>
 #include <algorithm>
 #include <iomanip>
 #include <memory>
+#include <functional>
+#include <list>
 #include <cfloat>
+#include <limits>
+#include <type_traits>
 #include <netcdf>
 
 using namespace netCDF;
@@ -36,7 +41,17 @@ using namespace netCDF::exceptions;
 #include "cgal_utils.hpp"
 #endif
 
+// MPI parallel I/O must be explicitly enabled and needs a netCDF library built with parallel support
+#ifdef ENABLE_MPI
+#include <mpi.h>
+#include <netcdf_par.h>
+#endif
+
 #include "marray.hxx"
+#include "geophysics_netcdf_parallel.hpp"
+#include "geophysics_netcdf_mask.hpp"
+#include "geophysics_netcdf_expression.hpp"
+#include "geophysics_netcdf_stats.hpp"
 
 namespace GeophysicsNetCDF {
 
@@ -76,8 +91,22 @@ inline int defaultmissingvalue(const NcInt&) { return static_cast<int>NC_FILL_IN
 inline unsigned int defaultmissingvalue(const NcUint&) { return static_cast<unsigned int>NC_FILL_UINT; }
 inline float defaultmissingvalue(const NcFloat&) { return static_cast<float>NC_FILL_FLOAT; }
 inline double defaultmissingvalue(const NcDouble&) { return static_cast<double>NC_FILL_DOUBLE; }
+inline unsigned short defaultmissingvalue(const NcUshort&) { return static_cast<unsigned short>NC_FILL_USHORT; }
+inline long long defaultmissingvalue(const NcInt64&) { return static_cast<long long>NC_FILL_INT64; }
+inline unsigned long long defaultmissingvalue(const NcUint64&) { return static_cast<unsigned long long>NC_FILL_UINT64; }
 inline std::string defaultmissingvalue(const NcString&) { return std::string(NC_FILL_STRING); }
 
+// Convert n values from the native type S to T in a single pass, replacing the fill value with replacement.
+// The loop body is a branch-free select so that compilers vectorise it.
+template<typename S, typename T>
+inline void convert_mapfill(const S* src, T* dst, const size_t n, const S fill, const T replacement)
+{
+	for (size_t i = 0; i < n; i++) {
+		const S v = src[i];
+		dst[i] = (v == fill) ? replacement : static_cast<T>(v);
+	}
+}
+
 class cExportFormat {
 
 public:
@@ -172,6 +201,34 @@ public:
 		return false;
 	}
 
+#ifdef ENABLE_MPI
+	//Switch between collective and independent access for a file opened for parallel I/O.
+	//Collective access is needed to write chunked compressed variables.
+	void set_collective(const bool collective = true) {
+		const int status = nc_var_par_access(getParentGroup().getId(), getId(), collective ? NC_COLLECTIVE : NC_INDEPENDENT);
+		if (status != NC_NOERR) {
+			std::string msg = _SRC_ + strprint("\nCould not set the parallel access of variable (%s): %s\n", getName().c_str(), nc_strerror(status));
+			throw(std::exception(msg.c_str()));
+		}
+	}
+
+	//Take part in a collective write or read without transferring any data,
+	//as done by ranks that have fewer lines to write or read than the others
+	void putNothing() const {
+		const std::vector<size_t> start(getDimCount(), 0);
+		const std::vector<size_t> count(getDimCount(), 0);
+		const char dummy = 0;
+		putVar(start, count, (const void*)&dummy);
+	}
+
+	void getNothing() const {
+		const std::vector<size_t> start(getDimCount(), 0);
+		const std::vector<size_t> count(getDimCount(), 0);
+		char dummy = 0;
+		getVar(start, count, (void*)&dummy);
+	}
+#endif
+
 	NcVarAtt add_attribute(const std::string& att, std::string value) {
 		return putAtt(att, value);
 	}
@@ -253,6 +310,9 @@ public:
 		case NC_UINT: putAtt(AN_MISSINGVALUE, ncUint, defaultmissingvalue(ncUint)); break;
 		case NC_FLOAT: putAtt(AN_MISSINGVALUE, ncFloat, defaultmissingvalue(ncFloat)); break;
 		case NC_DOUBLE: putAtt(AN_MISSINGVALUE, ncDouble, defaultmissingvalue(ncDouble)); break;
+		case NC_USHORT: putAtt(AN_MISSINGVALUE, ncUshort, defaultmissingvalue(ncUshort)); break;
+		case NC_INT64: putAtt(AN_MISSINGVALUE, ncInt64, defaultmissingvalue(ncInt64)); break;
+		case NC_UINT64: putAtt(AN_MISSINGVALUE, ncUint64, defaultmissingvalue(ncUint64)); break;
 		case NC_STRING: {
 			//std::string n = defaultmissingvalue(ncString);
 			//putAtt(AN_MISSINGVALUE, ncString, n.length(), n.c_str()); break;
@@ -290,6 +350,9 @@ public:
 			else if (type == ncInt)  return (T)NC_FILL_INT;
 			else if (type == ncFloat) return (T)NC_FILL_FLOAT;
 			else if (type == ncDouble) return (T)NC_FILL_DOUBLE;
+			else if (type == ncInt64) return (T)NC_FILL_INT64;
+			else if (type == ncUint64) return (T)NC_FILL_UINT64;
+			else if (type == ncUshort) return (T)NC_FILL_USHORT;
 			else return (T)NC_FILL_SHORT;
 		}
 	}
@@ -297,26 +360,281 @@ public:
 	template<typename T>
 	bool getAll(std::vector<T>& vals) {
 		vals.resize(length());
+		GIOScope scope(*this, "getAll");
+		scope.count(vals.size());
 		getVar(vals.data());
 		return true;
 	}
 
 	template<typename T>
 	bool minmax(T& minval, T& maxval) {
-		std::vector<T> vals;
-		getAll(vals);
-		T nullv;
-		nullv = missingvalue(nullv);
+		GIOScope scope(*this, "minmax");
 		minval = highest_possible_value();
 		maxval = lowest_possible_value();
-		for (size_t i = 0; i < vals.size(); i++) {
-			if (vals[i] == nullv) continue;
-			if (vals[i] < minval) minval = vals[i];
-			if (vals[i] > maxval) maxval = vals[i];
+		if constexpr (std::is_floating_point<T>::value) {
+			//Nulls are read as NaN, which fails every comparison, so they need no separate test
+			std::vector<NcDim> dims = getDims();
+			if (dims.size() == 0) return true;
+			std::vector<size_t> start(dims.size(), 0);
+			std::vector<size_t> count(dims.size());
+			const size_t eps = elementspersample();
+			for (size_t i = 1; i < dims.size(); i++) count[i] = dims[i].getSize();
+			const size_t nrows = dims[0].getSize();
+			const size_t blockrows = std::max((size_t)1, ((size_t)1 << 20) / std::max((size_t)1, eps));
+			std::vector<T> vals;
+			for (size_t r = 0; r < nrows; r += blockrows) {
+				start[0] = r;
+				count[0] = std::min(blockrows, nrows - r);
+				vals.resize(count[0] * eps);
+				scope.count(vals.size());
+				getVarMapped(start, count, vals.data(), std::numeric_limits<T>::quiet_NaN());
+				for (size_t i = 0; i < vals.size(); i++) {
+					const T v = vals[i];
+					minval = v < minval ? v : minval;
+					maxval = v > maxval ? v : maxval;
+				}
+			}
+		}
+		else {
+			std::vector<T> vals;
+			getAll(vals);
+			scope.count(vals.size());
+			T nullv;
+			nullv = missingvalue(nullv);
+			for (size_t i = 0; i < vals.size(); i++) {
+				if (vals[i] == nullv) continue;
+				if (vals[i] < minval) minval = vals[i];
+				if (vals[i] > maxval) maxval = vals[i];
+			}
+		}
+		return true;
+	}
+
+	//Read a hyperslab in the variable's native type and convert it to T in one pass,
+	//replacing _FillValue with replacement (e.g. NaN or an export null value)
+	template<typename T>
+	void getVarMapped(const std::vector<size_t>& start, const std::vector<size_t>& count, T* vals, const T replacement) const {
+		size_t n = 1;
+		for (size_t i = 0; i < count.size(); i++) n *= count[i];
+		if (n == 0) return;
+
+		GIOScope scope(*this, "getVarMapped");
+		scope.count(n);
+		switch (getType().getId()) {
+		case NC_UBYTE: read_mapped<uint8_t>(start, count, n, vals, replacement); break;
+		case NC_BYTE: read_mapped<int8_t>(start, count, n, vals, replacement); break;
+		case NC_SHORT: read_mapped<short>(start, count, n, vals, replacement); break;
+		case NC_INT: read_mapped<int>(start, count, n, vals, replacement); break;
+		case NC_UINT: read_mapped<unsigned int>(start, count, n, vals, replacement); break;
+		case NC_FLOAT: read_mapped<float>(start, count, n, vals, replacement); break;
+		case NC_DOUBLE: read_mapped<double>(start, count, n, vals, replacement); break;
+		case NC_USHORT: read_mapped<unsigned short>(start, count, n, vals, replacement); break;
+		case NC_INT64: read_mapped<long long>(start, count, n, vals, replacement); break;
+		case NC_UINT64: read_mapped<unsigned long long>(start, count, n, vals, replacement); break;
+		default: {
+			std::string msg = _SRC_ + strprint("\nAttempt to read variable (%s) of unsupported datatype\n", getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		}
+	}
+
+	//Read a line with _FillValue replaced by replacement
+	template<typename T>
+	bool getLineMapped(const size_t& lineindex, std::vector<T>& vals, const T replacement) const {
+		std::vector<size_t> start, count;
+		line_hyperslab(lineindex, start, count);
+		vals.resize(lineelements_or_bands(count));
+		GIOScope scope(*this, "getLineMapped");
+		scope.count(vals.size());
+		getVarMapped(start, count, vals.data(), replacement);
+		return true;
+	}
+
+	//Read a line with _FillValue replaced by NaN
+	template<typename T>
+	bool getLineMapped(const size_t& lineindex, std::vector<T>& vals) const {
+		static_assert(std::is_floating_point<T>::value, "Fill values can only be mapped to NaN for floating point types");
+		return getLineMapped(lineindex, vals, std::numeric_limits<T>::quiet_NaN());
+	}
+
+	template<typename T>
+	void getLineMapped(const size_t& lineindex, andres::Marray<T>& A, const T replacement) const {
+		std::vector<size_t> start, count;
+		line_hyperslab(lineindex, start, count);
+		A.resize(count.data(), count.data() + count.size());
+		GIOScope scope(*this, "getLineMapped");
+		scope.count(A.size());
+		getVarMapped(start, count, &(A(0)), replacement);
+	}
+
+	//Read a line and build the validity mask of its elements
+	template<typename T>
+	bool getLineMasked(const size_t& lineindex, std::vector<T>& vals, GValidityMask& mask) const {
+		std::vector<size_t> start, count;
+		line_hyperslab(lineindex, start, count);
+		vals.resize(lineelements_or_bands(count));
+		GIOScope scope(*this, "getLineMasked");
+		scope.count(vals.size());
+		if (vals.size() > 0) getVar(start, count, vals.data());
+		mask.build(vals.data(), vals.size(), missingvalue(T()));
+		return true;
+	}
+
+	//Number of null elements in the variable, counted in blocks with validity masks
+	size_t nnull() const {
+		GIOScope scope(*this, "nnull");
+		std::vector<NcDim> dims = getDims();
+		if (dims.size() == 0) return 0;
+		std::vector<size_t> start(dims.size(), 0);
+		std::vector<size_t> count(dims.size());
+		const size_t eps = elementspersample();
+		for (size_t i = 1; i < dims.size(); i++) count[i] = dims[i].getSize();
+		const size_t nrows = dims[0].getSize();
+		const size_t blockrows = std::max((size_t)1, ((size_t)1 << 20) / std::max((size_t)1, eps));
+		std::vector<double> vals;
+		GValidityMask mask;
+		size_t n = 0;
+		for (size_t r = 0; r < nrows; r += blockrows) {
+			start[0] = r;
+			count[0] = std::min(blockrows, nrows - r);
+			vals.resize(count[0] * eps);
+			scope.count(vals.size());
+			getVarMapped(start, count, vals.data(), std::numeric_limits<double>::quiet_NaN());
+			mask.build_nan(vals.data(), vals.size());
+			n += mask.nnull();
+		}
+		return n;
+	}
+
+private:
+
+	template<typename S, typename T>
+	void read_mapped(const std::vector<size_t>& start, const std::vector<size_t>& count, const size_t n, T* vals, const T replacement) const {
+		const S fill = missingvalue(S());
+		if constexpr (std::is_same<S, T>::value) {
+			getVar(start, count, vals);
+			convert_mapfill(vals, vals, n, fill, replacement);
+		}
+		else {
+			thread_local std::vector<S> buf;
+			buf.resize(n);
+			getVar(start, count, buf.data());
+			convert_mapfill(buf.data(), vals, n, fill, replacement);
+		}
+	}
+
+	//Start and count of the hyperslab holding all bands of a line
+	void line_hyperslab(const size_t& lineindex, std::vector<size_t>& start, std::vector<size_t>& count) const {
+		if (isNull()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read from a Null variable\n");
+			throw(std::exception(msg.c_str()));
+		}
+		std::vector<NcDim> dims = getDims();
+		start.resize(dims.size());
+		count.resize(dims.size());
+		if (isLineVar()) {
+			start[0] = lineindex;
+			count[0] = 1;
+		}
+		else {
+			start[0] = line_index_start(lineindex);
+			count[0] = line_index_count(lineindex);
+		}
+		for (size_t i = 1; i < dims.size(); i++) {
+			start[i] = 0;
+			count[i] = dims[i].getSize();
+		}
+	}
+
+	static size_t lineelements_or_bands(const std::vector<size_t>& count) {
+		size_t n = 1;
+		for (size_t i = 0; i < count.size(); i++) n *= count[i];
+		return n;
+	}
+
+	//As line_hyperslab() for a multiband variable, checking that the bands exist
+	void band_hyperslab(const size_t& lineindex, const size_t& bandfirst, const size_t& nb, std::vector<size_t>& start, std::vector<size_t>& count) const {
+		line_hyperslab(lineindex, start, count);
+		if (count.size() != 2) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read bands of variable (%s) which is not a multiband variable\n", getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		if (bandfirst + nb > count[1]) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read bands %zu to %zu of variable (%s) which has %zu bands\n", bandfirst, bandfirst + nb - 1, getName().c_str(), count[1]);
+			throw(std::exception(msg.c_str()));
+		}
+		start[1] = bandfirst;
+		count[1] = nb;
+	}
+
+public:
+
+	//Contiguous runs (first band, number of bands) covering the distinct bands of a list, in ascending order
+	static std::vector<std::pair<size_t, size_t>> band_runs(std::vector<size_t> bands) {
+		std::sort(bands.begin(), bands.end());
+		bands.erase(std::unique(bands.begin(), bands.end()), bands.end());
+		std::vector<std::pair<size_t, size_t>> runs;
+		for (size_t k = 0; k < bands.size(); k++) {
+			if (runs.size() && runs.back().first + runs.back().second == bands[k]) runs.back().second++;
+			else runs.push_back(std::make_pair(bands[k], (size_t)1));
+		}
+		return runs;
+	}
+
+	//Read bands [bandfirst, bandfirst + nb) of a line with one hyperslab, sample major
+	template<typename T>
+	bool getLineBands(const size_t& lineindex, const size_t& bandfirst, const size_t& nb, std::vector<T>& vals) const {
+		std::vector<size_t> start, count;
+		band_hyperslab(lineindex, bandfirst, nb, start, count);
+		vals.resize(count[0] * nb);
+		if (vals.size() == 0) return true;
+		GIOScope scope(*this, "getLineBands");
+		scope.count(vals.size());
+		getVar(start, count, vals.data());
+		return true;
+	}
+
+	//Read a list of bands of a line, sample major with the bands in the order listed.
+	//Only the listed bands are read, with one hyperslab for each run of consecutive bands (see band_runs()).
+	template<typename T>
+	bool getLineBands(const size_t& lineindex, const std::vector<size_t>& bands, std::vector<T>& vals) const {
+		const size_t nb = bands.size();
+		bool consecutive = nb > 0;
+		for (size_t k = 1; k < nb && consecutive; k++) consecutive = bands[k] == bands[0] + k;
+		if (consecutive) return getLineBands(lineindex, bands[0], nb, vals);
+
+		std::vector<size_t> start, count;
+		band_hyperslab(lineindex, 0, 0, start, count);
+		const size_t ns = count[0];
+		vals.resize(ns * nb);
+		if (vals.size() == 0) return true;
+
+		GIOScope scope(*this, "getLineBands");
+		scope.count(vals.size());
+		std::vector<T> buf;
+		for (const auto& run : band_runs(bands)) {
+			band_hyperslab(lineindex, run.first, run.second, start, count);
+			buf.resize(ns * run.second);
+			getVar(start, count, buf.data());
+			for (size_t k = 0; k < nb; k++) {
+				if (bands[k] < run.first || bands[k] >= run.first + run.second) continue;
+				const size_t col = bands[k] - run.first;
+				for (size_t si = 0; si < ns; si++) vals[si * nb + k] = buf[si * run.second + col];
+			}
 		}
 		return true;
 	}
 
+	//As above into a nsamples x nbands array
+	template<typename T>
+	void getLineBands(const size_t& lineindex, const std::vector<size_t>& bands, andres::Marray<T>& A) const {
+		std::vector<T> vals;
+		getLineBands(lineindex, bands, vals);
+		const size_t shape[2] = { bands.size() ? vals.size() / bands.size() : 0, bands.size() };
+		A.resize(shape, shape + 2);
+		if (vals.size()) std::copy(vals.begin(), vals.end(), &(A(0)));
+	}
+
 	template<typename T>
 	void getLine(const size_t& lineindex, andres::Marray<T>& A) const {
 		if (isNull()) {
@@ -343,6 +661,8 @@ public:
 		}
 
 		A.resize(count.data(), count.data() + count.size());
+		GIOScope scope(*this, "getLine");
+		scope.count(A.size());
 		getVar(start, count, &(A(0)));
 	}
 
@@ -357,6 +677,8 @@ public:
 		std::vector<size_t> startp = { record, 0 };
 		std::vector<size_t> countp = { 1,      nbands() };
 		v.resize(nbands());
+		GIOScope scope(*this, "getRecord");
+		scope.count(v.size());
 		getVar(startp, countp, v.data());
 		return true;
 	};
@@ -371,6 +693,8 @@ public:
 		}
 		std::vector<size_t> startp = { record, 0 };
 		std::vector<size_t> countp = { 1,      1 };
+		GIOScope scope(*this, "putRecord");
+		scope.count(1);
 		putVar(startp, countp, &v);
 		return true;
 	};
@@ -386,6 +710,8 @@ public:
 		std::vector<size_t> startp = { record, 0 };
 		std::vector<size_t> countp = { 1,      nbands() };
 		assert(countp[1] == v.size());
+		GIOScope scope(*this, "putRecord");
+		scope.count(v.size());
 		putVar(startp, countp, v.data());
 		return true;
 	};
@@ -412,6 +738,9 @@ public:
 		case NC_UINT: e = cExportFormat('I', 12, 0, 999); break;
 		case NC_FLOAT: e = cExportFormat('F', 10, 4, -999); break;
 		case NC_DOUBLE: e = cExportFormat('F', 16, 6, -999); break;
+		case NC_USHORT: e = cExportFormat('I', 8, 0, 999); break;
+		case NC_INT64: e = cExportFormat('I', 21, 0, -999); break;
+		case NC_UINT64: e = cExportFormat('I', 21, 0, 999); break;
 		default: e = cExportFormat('F', 16, 6, -999);  break;
 		}
 		return e;
@@ -440,6 +769,8 @@ public:
 			throw(std::exception(msg.c_str()));
 		}
 
+		GIOScope scope(*this, "putAll");
+		scope.count(vals.size());
 		putVar(vals.data());
 		return true;
 	}
@@ -449,6 +780,8 @@ public:
 		if (isNull()) { return false; }
 		std::vector<size_t> startp = { lineindex, bandindex };
 		std::vector<size_t> countp = { 1, 1 };
+		GIOScope scope(*this, "getLine");
+		scope.count(1);
 		getVar(startp, countp, &val);
 		return true;
 	}
@@ -464,6 +797,8 @@ public:
 		std::vector<size_t> startp = { lineindex, bandindex };
 		std::vector<size_t> countp = { 1, 1 };
 		vals.resize(countp[0] * countp[1]);
+		GIOScope scope(*this, "getLine");
+		scope.count(vals.size());
 		getVar(startp, countp, vals.data());
 		return true;
 	}
@@ -478,12 +813,86 @@ public:
 		if (isNull()) { return false; }
 		std::vector<size_t> startp = { lineindex, bandindex };
 		std::vector<size_t> countp = { 1, 1 };
+		GIOScope scope(*this, "getSample");
+		scope.count(1);
 		getVar(startp, countp, &val);
 		return val;
 	};
 
 };
 
+// The samples selected by a predicate, see GFile::select().
+// Only lines with at least one selected sample are listed, in line order.
+class GSelection {
+
+public:
+
+	class cLine {
+	public:
+		size_t lineindex = 0;
+		GValidityMask mask;//one bit per sample of the line, set where selected
+	};
+
+	std::string Predicate;
+	std::vector<cLine> Lines;
+	size_t NLinesPruned = 0;//lines ruled out by their summaries without being read
+
+	size_t nlines() const { return Lines.size(); }
+
+	size_t nselected() const {
+		size_t n = 0;
+		for (const cLine& l : Lines) n += l.mask.count();
+		return n;
+	}
+
+	std::vector<size_t> lineindices() const {
+		std::vector<size_t> li(Lines.size());
+		for (size_t i = 0; i < Lines.size(); i++) li[i] = Lines[i].lineindex;
+		return li;
+	}
+};
+
+// A contiguous run of samples within one line, see GFile::partition().
+class GSegment {
+public:
+	size_t lineindex = 0;
+	size_t offset = 0;//first sample relative to the start of the line
+	size_t count = 0;
+};
+
+// Cost model used to balance a partition, the cost of a segment is persegment + persample * count
+class cPartitionCost {
+public:
+	double persegment = 0.0;//fixed cost of each segment, eg the overhead of the read calls
+	double persample = 1.0;//cost of each sample, eg the bytes per sample of the variables read
+
+	double cost(const size_t count) const {
+		return persegment + persample * (double)count;
+	}
+};
+
+// One piece of a partition of the samples of a file, segments are in line order
+class GPartition {
+
+public:
+
+	std::vector<GSegment> Segments;
+
+	size_t nsegments() const { return Segments.size(); }
+
+	size_t nsamples() const {
+		size_t n = 0;
+		for (const GSegment& s : Segments) n += s.count;
+		return n;
+	}
+
+	double cost(const cPartitionCost& model) const {
+		double c = 0.0;
+		for (const GSegment& s : Segments) c += model.cost(s.count);
+		return c;
+	}
+};
+
 class GSampleVar : public GVar {
 
 private:
@@ -506,6 +915,8 @@ public:
 			throw(std::exception(msg.c_str()));
 		}
 
+		GIOScope scope(*this, "putAll");
+		scope.count(vals.size());
 		putVar(vals.data());
 		return true;
 	}
@@ -534,6 +945,8 @@ public:
 		count[0] = line_index_count(lineindex);
 		start[1] = bandindex;
 		count[1] = 1;
+		GIOScope scope(*this, "putLineBand");
+		scope.count(vals.size());
 		putVar(start, count, vals.data());
 		return true;
 	}
@@ -560,6 +973,8 @@ public:
 			start[i] = 0;
 			count[i] = dims[i].getSize();
 		}
+		GIOScope scope(*this, "putLine");
+		scope.count(vals.size());
 		putVar(start, count, vals.data());
 		return true;
 	}
@@ -582,6 +997,8 @@ public:
 		}
 		size_t sz = lineelements(lineindex);
 		vals.resize(sz);
+		GIOScope scope(*this, "getLine");
+		scope.count(vals.size());
 		getVar(start, count, vals.data());
 		return true;
 	}
@@ -603,14 +1020,152 @@ public:
 		}
 		A.resize(count.data(), count.data() + count.size());
 		size_t sz = lineelements(lineindex);
+		GIOScope scope(*this, "getLine");
+		scope.count(A.size());
 		getVar(start, count, &(A(0)));
 	}
 
+	//Read only the selected samples of one line of a selection, each run of consecutive samples with one read
+	template<typename T>
+	bool getSelected(const GSelection::cLine& line, std::vector<T>& vals) const {
+		if (isNull()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read from a Null variable\n");
+			throw(std::exception(msg.c_str()));
+		}
+
+		std::vector<NcDim>  dims = getDims();
+		std::vector<size_t> start(dims.size(), 0);
+		std::vector<size_t> count(dims.size());
+		for (size_t i = 1; i < dims.size(); i++) count[i] = dims[i].getSize();
+
+		const size_t eps = elementspersample();
+		const size_t first = line_index_start(line.lineindex);
+		vals.resize(line.mask.count() * eps);
+		GIOScope scope(*this, "getSelected");
+		scope.count(vals.size());
+		size_t k = 0;
+		for (const auto& r : line.mask.runs()) {
+			start[0] = first + r.first;
+			count[0] = r.second;
+			getVar(start, count, &vals[k]);
+			k += r.second * eps;
+		}
+		return true;
+	}
+
+	//Read the samples of a segment, all bands, sample major
+	template<typename T>
+	bool getSegment(const GSegment& segment, std::vector<T>& vals) const {
+		if (isNull()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read from a Null variable\n");
+			throw(std::exception(msg.c_str()));
+		}
+
+		std::vector<NcDim>  dims = getDims();
+		std::vector<size_t> start(dims.size(), 0);
+		std::vector<size_t> count(dims.size());
+		start[0] = line_index_start(segment.lineindex) + segment.offset;
+		count[0] = segment.count;
+		for (size_t i = 1; i < dims.size(); i++) count[i] = dims[i].getSize();
+		vals.resize(segment.count * elementspersample());
+		if (vals.size() == 0) return true;
+		GIOScope scope(*this, "getSegment");
+		scope.count(vals.size());
+		getVar(start, count, vals.data());
+		return true;
+	}
+
+	//Write the samples of a segment, all bands, sample major. A segment with no samples makes no call.
+	template<typename T>
+	bool putSegment(const GSegment& segment, const std::vector<T>& vals) {
+		if (isNull()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write to a Null variable\n");
+			throw(std::exception(msg.c_str()));
+		}
+
+		if (vals.size() != segment.count * elementspersample()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write segment of variable (%s) with non-matching size\n", getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+
+		std::vector<NcDim>  dims = getDims();
+		std::vector<size_t> start(dims.size(), 0);
+		std::vector<size_t> count(dims.size());
+		start[0] = line_index_start(segment.lineindex) + segment.offset;
+		count[0] = segment.count;
+		for (size_t i = 1; i < dims.size(); i++) count[i] = dims[i].getSize();
+		if (vals.size() == 0) return true;
+		GIOScope scope(*this, "putSegment");
+		scope.count(vals.size());
+		putVar(start, count, vals.data());
+		return true;
+	}
+
+	//Read every stride'th sample of a line (samples 0, stride, 2*stride, ...), all bands, with one strided hyperslab
+	template<typename T>
+	bool getLineStrided(const size_t& lineindex, const size_t& stride, std::vector<T>& vals) const {
+		if (isNull()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read from a Null variable\n");
+			throw(std::exception(msg.c_str()));
+		}
+
+		std::vector<NcDim>  dims = getDims();
+		std::vector<size_t> start(dims.size(), 0);
+		std::vector<size_t> count(dims.size());
+		std::vector<ptrdiff_t> strides(dims.size(), 1);
+		const size_t s = std::max((size_t)1, stride);
+		const size_t ns = line_index_count(lineindex);
+		start[0] = line_index_start(lineindex);
+		count[0] = (ns + s - 1) / s;
+		strides[0] = (ptrdiff_t)s;
+		for (size_t i = 1; i < dims.size(); i++) count[i] = dims[i].getSize();
+		vals.resize(count[0] * elementspersample());
+		if (vals.size() == 0) return true;
+		GIOScope scope(*this, "getLineStrided");
+		scope.count(vals.size());
+		getVar(start, count, strides, vals.data());
+		return true;
+	}
+
+	//Decimate one band of a line for plotting. The line is split into nbuckets buckets,
+	//bucket b holding samples [b*n/nbuckets, (b+1)*n/nbuckets), and the minimum and maximum
+	//of each are returned so that spikes are kept. Nulls are ignored, a bucket of only nulls gives NaN.
+	bool getLineDecimated(const size_t& lineindex, const size_t& nbuckets, std::vector<double>& vmin, std::vector<double>& vmax, const size_t& bandindex = 0) const {
+		std::vector<double> vals;
+		if (getDimCount() == 1) {
+			getLineMapped(lineindex, vals);
+		}
+		else {
+			getLineBands(lineindex, bandindex, 1, vals);
+			const double fill = missingvalue(double());
+			const double nan = std::numeric_limits<double>::quiet_NaN();
+			for (double& v : vals) v = (v == fill) ? nan : v;
+		}
+
+		const size_t n = vals.size();
+		const size_t nb = std::min(nbuckets, n);
+		vmin.assign(nb, std::numeric_limits<double>::quiet_NaN());
+		vmax.assign(nb, std::numeric_limits<double>::quiet_NaN());
+		for (size_t b = 0; b < nb; b++) {
+			const size_t first = b * n / nb;
+			const size_t last = (b + 1) * n / nb;
+			for (size_t si = first; si < last; si++) {
+				const double v = vals[si];
+				if (v != v) continue;
+				if (!(v >= vmin[b])) vmin[b] = v;
+				if (!(v <= vmax[b])) vmax[b] = v;
+			}
+		}
+		return true;
+	}
+
 	template<typename T>
 	bool getSample(const size_t& lineindex, const size_t& sampleindex, const size_t& bandindex, T& val) const {
 		if (isNull()) { return false; }
 		std::vector<size_t> startp = { line_index_start(lineindex) + sampleindex, bandindex };
 		std::vector<size_t> countp = { 1, 1 };
+		GIOScope scope(*this, "getSample");
+		scope.count(1);
 		getVar(startp, countp, &val);
 		return true;
 	};
@@ -633,6 +1188,70 @@ public:
 
 };
 
+// Null value used for T when values computed with NaN nulls are stored in or returned as T
+template<typename T>
+inline T default_fill() {
+	if constexpr (std::is_floating_point<T>::value) return std::numeric_limits<T>::quiet_NaN();
+	else if constexpr (std::is_same<T, uint8_t>::value) return defaultmissingvalue(ncUbyte);
+	else if constexpr (std::is_same<T, int8_t>::value) return defaultmissingvalue(ncByte);
+	else if constexpr (std::is_same<T, short>::value) return defaultmissingvalue(ncShort);
+	else if constexpr (std::is_same<T, unsigned int>::value) return defaultmissingvalue(ncUint);
+	else return (T)defaultmissingvalue(ncInt);
+}
+
+// A virtual variable computed on demand from stored or other derived variables.
+// It is defined by a GExpression or by a C++ callable and evaluated a line at a time
+// when read through GFile::getDataByLineIndex(), nothing is written to the file.
+// Inputs are read as double with nulls as NaN, and NaN in the result is a null.
+// If cachelines > 0 the results of the most recently read lines are memoised.
+class GDerivedVar {
+
+public:
+
+	// Computes one line. Each input holds nsamples x nbands values (1-band and line
+	// variables are repeated to fit) and out must be filled with nsamples x nbands values.
+	using Function = std::function<void(const std::vector<const double*>& inputs, const size_t nsamples, const size_t nbands, std::vector<double>& out)>;
+
+private:
+
+	std::string Name;
+	std::vector<std::string> Inputs;
+	Function Evaluate;
+	size_t CacheLines = 0;
+
+	mutable std::mutex CacheMutex;
+	mutable std::list<std::pair<size_t, std::vector<double>>> Cache;//most recently used first
+	mutable size_t NBands = 0;
+
+public:
+
+	GDerivedVar(const std::string& name, const std::string& expression, const size_t cachelines = 0)
+		: Name(name), CacheLines(cachelines)
+	{
+		std::shared_ptr<GExpression> e = std::make_shared<GExpression>(expression);
+		Inputs = e->variables();
+		Evaluate = [e](const std::vector<const double*>& inputs, const size_t nsamples, const size_t nbands, std::vector<double>& out) {
+			e->evaluate(inputs, nsamples * nbands, out);
+		};
+	}
+
+	GDerivedVar(const std::string& name, const std::vector<std::string>& inputs, const Function& f, const size_t cachelines = 0)
+		: Name(name), Inputs(inputs), Evaluate(f), CacheLines(cachelines)
+	{}
+
+	const std::string& getName() const { return Name; }
+
+	const std::vector<std::string>& inputs() const { return Inputs; }
+
+	void clear_cache() const {
+		std::lock_guard<std::mutex> lock(CacheMutex);
+		Cache.clear();
+	}
+
+	//Compute (or recall) one line, vals holds nsamples x nbands values
+	bool getLine(GFile& file, const size_t& lineindex, std::vector<double>& vals, size_t& nbands) const;
+};
+
 class GFile : public NcFile {
 
 private:
@@ -640,18 +1259,30 @@ private:
 	std::vector<unsigned int> line_index_start;
 	std::vector<unsigned int> line_index_count;
 	std::vector<unsigned int> line_number;
+	size_t ncommittedlines = 0;//lines visible to readers of an appendable file
+	std::map<std::string, std::shared_ptr<GDerivedVar>> DerivedVars;
 
 	NcDim dim_sample() { return getDim(DN_POINT); }
 
 	NcDim dim_line() { return getDim(DN_LINE); }
 
+	//Dump (if requested) and forget the I/O statistics of this file
+	void release_stats() {
+		if (isNull() || GIOStats::global().has(getId()) == false) return;
+		GIOStats::global().close(getId(), pathname());
+	}
+
 	bool InitialiseExisting() {
 		if (readLineIndex() == false) return false;
 		if (getLineNumbers(line_number) == false) return false;
+		//An appendable file may have line numbers for lines not yet committed to the line_index
+		if (line_number.size() > nlines()) line_number.resize(nlines());
+		ncommittedlines = nlines();
 		return true;
 	}
 
 	bool readLineIndex() {
+		GIOScope scope(getId(), "readLineIndex");
 		if (hasVar(VN_LI_COUNT)) {
 			GLineVar vc = getLineVar(VN_LI_COUNT);
 			if (vc.getAll(line_index_count) == false)return false;
@@ -663,6 +1294,9 @@ private:
 			GLineVar vl = getLineVar(VN_LINE_INDEX);
 			std::vector<unsigned int> line_index;
 			if (vl.getAll(line_index) == false)return false;
+			//Trailing unwritten entries belong to lines still being appended
+			unsigned int fill = vl.missingvalue(fill);
+			line_index.erase(std::find(line_index.begin(), line_index.end(), fill), line_index.end());
 			set_start_count(line_index);
 		}
 
@@ -686,6 +1320,11 @@ private:
 
 	void set_start_count(const std::vector<unsigned int>& line_index)
 	{
+		if (line_index.size() == 0) {
+			line_index_start.clear();
+			line_index_count.clear();
+			return;
+		}
 		line_index_start = compute_start_from_line_index(line_index);
 		line_index_count = compute_count_from_start(line_index_start, line_index.size());
 		return;
@@ -773,8 +1412,40 @@ public:
 		open(ncpath, filemode);
 	};
 
+#ifdef ENABLE_MPI
+	//Open or create a netCDF-4 file for parallel I/O by every rank of comm (collective).
+	//Variables start with independent access, see set_collective().
+	GFile(MPI_Comm comm, const std::string& ncpath, const netCDF::NcFile::FileMode& filemode = netCDF::NcFile::FileMode::read, MPI_Info info = MPI_INFO_NULL)
+		: netCDF::NcFile()
+	{
+		open(comm, ncpath, filemode, info);
+	};
+#endif
+
 	//Destructor
-	~GFile() {};
+	~GFile() {
+		try {
+			release_stats();
+		}
+		catch (...) {
+		}
+	};
+
+	//Close the file, dumping its I/O statistics first if requested
+	void close() {
+		release_stats();
+		NcFile::close();
+	}
+
+	//Snapshot of the I/O statistics gathered for this file while GIOStats is enabled
+	std::vector<cIOStat> stats() const {
+		if (isNull()) return std::vector<cIOStat>();
+		return GIOStats::global().snapshot(getId());
+	}
+
+	std::string stats_json() const {
+		return GIOStats::to_json(isNull() ? std::string() : pathname(), stats());
+	}
 
 	size_t get_line_index_start(const size_t& li) const { return line_index_start[li]; }
 	size_t get_line_index_count(const size_t& li) const { return line_index_count[li]; }
@@ -802,12 +1473,15 @@ public:
 
 	void open(const std::string& ncpath, const FileMode& filemode = NcFile::FileMode::read)
 	{
+		GIOScope scope(0, "open");
 		if (filemode == NcFile::read) {
 			NcFile::open(ncpath, filemode);
+			scope.file(getId());
 			InitialiseExisting();
 		}
 		else if (filemode == NcFile::write) {
 			NcFile::open(ncpath, filemode);
+			scope.file(getId());
 			InitialiseExisting();
 		}
 		else if (filemode == NcFile::replace) {
@@ -821,6 +1495,49 @@ public:
 		}
 	}
 
+#ifdef ENABLE_MPI
+	void open(MPI_Comm comm, const std::string& ncpath, const FileMode& filemode, MPI_Info info = MPI_INFO_NULL)
+	{
+		if (isNull() == false) close();
+
+		GIOScope scope(0, "open");
+		int id = -1;
+		int status = NC_NOERR;
+		if (filemode == NcFile::read) {
+			status = nc_open_par(ncpath.c_str(), NC_NOWRITE, comm, info, &id);
+		}
+		else if (filemode == NcFile::write) {
+			status = nc_open_par(ncpath.c_str(), NC_WRITE, comm, info, &id);
+		}
+		else if (filemode == NcFile::replace) {
+			status = nc_create_par(ncpath.c_str(), NC_NETCDF4 | NC_CLOBBER, comm, info, &id);
+		}
+		else {
+			status = nc_create_par(ncpath.c_str(), NC_NETCDF4 | NC_NOCLOBBER, comm, info, &id);
+		}
+
+		if (status != NC_NOERR) {
+			std::string msg = _SRC_ + strprint("\nCould not open file (%s) for parallel I/O: %s\n", ncpath.c_str(), nc_strerror(status));
+			throw(std::exception(msg.c_str()));
+		}
+		myId = id;
+		nullObject = false;
+		scope.file(getId());
+
+		if (filemode == NcFile::read || filemode == NcFile::write) {
+			InitialiseExisting();
+		}
+	}
+
+	//Set collective or independent parallel access for every variable in the file
+	void set_collective(const bool collective = true) {
+		auto vm = getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			GVar(*this, vit->second).set_collective(collective);
+		}
+	}
+#endif
+
 	bool InitialiseNew(const std::vector<size_t>& linenumbers, const std::vector<size_t>& linesamplecount) {
 		size_t n = linenumbers.size();
 		std::vector<unsigned int> uint_linenumbers(n);
@@ -842,8 +1559,7 @@ public:
 		NcDim ds = addDim(DN_POINT, nsamples);
 		NcDim dl = addDim(DN_LINE, nl);
 
-		std::vector<unsigned int> line_index = compute_line_index(line_index_count);
-		bool status = add_line_index(line_index);
+		bool status = add_line_index_from_counts();
 		if (status == false) {
 			std::string msg = _SRC_ + strprint("\nCould no add line_index variable (%s)\n", VN_LINE_INDEX);
 			throw(std::exception(msg.c_str()));
@@ -858,6 +1574,80 @@ public:
 		return true;
 	}
 
+	//Initialise a new file with unlimited point and line dimensions so that
+	//whole lines can be added one at a time with appendLine() and commitLines()
+	bool InitialiseAppendable() {
+		line_number.clear();
+		line_index_start.clear();
+		line_index_count.clear();
+		ncommittedlines = 0;
+
+		NcGroup::addDim(DN_POINT);
+		NcGroup::addDim(DN_LINE);
+
+		bool status = addSampleVar(VN_LINE_INDEX, ncUint);
+		if (status == false) {
+			std::string msg = _SRC_ + strprint("\nCould no add line_index variable (%s)\n", VN_LINE_INDEX);
+			throw(std::exception(msg.c_str()));
+		}
+		GSampleVar vi = getSampleVar(VN_LINE_INDEX);
+		vi.add_long_name(LN_LINE_INDEX);
+		vi.add_description("zero-based index of line associated with point");
+
+		status = addLineVar(DN_LINE, ncUint);
+		if (status == false) {
+			std::string msg = _SRC_ + strprint("\nCould no add line_number variable (%s)\n", DN_LINE);
+			throw(std::exception(msg.c_str()));
+		}
+		GLineVar vl = getLineVar(DN_LINE);
+		vl.add_long_name(LN_LINE_NUMBER);
+		vl.add_description("flight line number");
+		return true;
+	}
+
+	bool isAppendable() {
+		return dim_sample().isUnlimited() && dim_line().isUnlimited();
+	}
+
+	//Add a new line of nsamples samples to the end of an appendable file and return its line index.
+	//Its data is then written with the usual putLine()/putLineBand() calls.
+	//The line is not visible to readers until commitLines() is called.
+	size_t appendLine(const unsigned int linenumber, const size_t nsamples) {
+		if (isAppendable() == false) {
+			std::string msg = _SRC_ + strprint("\nAttempt to append a line to a file without unlimited %s and %s dimensions\n", DN_POINT, DN_LINE);
+			throw(std::exception(msg.c_str()));
+		}
+		const size_t start = line_index_start.size() ? (size_t)line_index_start.back() + line_index_count.back() : 0;
+		line_number.push_back(linenumber);
+		line_index_start.push_back((unsigned int)start);
+		line_index_count.push_back((unsigned int)nsamples);
+		return nlines() - 1;
+	}
+
+	//Publish all appended lines. Line numbers are written before the line_index
+	//entries and the file is synced, so a reader that opens the file after
+	//commitLines() returns (or after it is closed) sees whole lines only.
+	//netCDF-4 has no concurrent reader support, so a reader opened while the
+	//writer is active may see inconsistent metadata or fail to open the file.
+	bool commitLines() {
+		if (ncommittedlines == nlines()) return true;
+		const size_t nnew = nlines() - ncommittedlines;
+
+		GLineVar vl = getLineVar(DN_LINE);
+		vl.putVar({ ncommittedlines }, { nnew }, &line_number[ncommittedlines]);
+
+		GSampleVar vi = getSampleVar(VN_LINE_INDEX);
+		std::vector<unsigned int> buf;
+		for (size_t li = ncommittedlines; li < nlines(); li++) {
+			if (line_index_count[li] == 0) continue;
+			buf.assign(line_index_count[li], (unsigned int)li);
+			vi.putVar({ (size_t)line_index_start[li] }, { (size_t)line_index_count[li] }, buf.data());
+		}
+		sync();
+		ncommittedlines = nlines();
+		return true;
+	}
+
 	bool add_line_index(const std::vector<unsigned int> line_index)
 	{
 		bool status = addSampleVar(VN_LINE_INDEX, ncUint);
@@ -871,6 +1661,25 @@ public:
 		return status;
 	}
 
+	//Writes the line_index variable one line at a time from the line counts,
+	//so the full index is never held in memory
+	bool add_line_index_from_counts()
+	{
+		bool status = addSampleVar(VN_LINE_INDEX, ncUint);
+		if (status) {
+			GSampleVar v = getSampleVar(VN_LINE_INDEX);
+			std::vector<unsigned int> buf;
+			for (size_t li = 0; li < nlines(); li++) {
+				if (line_index_count[li] == 0) continue;
+				buf.assign(line_index_count[li], (unsigned int)li);
+				v.putVar({ (size_t)line_index_start[li] }, { (size_t)line_index_count[li] }, buf.data());
+			}
+			v.add_long_name(LN_LINE_INDEX);
+			v.add_description("zero-based index of line associated with point");
+		}
+		return status;
+	}
+
 	//Deprecated
 	bool add_line_index_start(const std::vector<unsigned int> line_index_start)
 	{
@@ -934,68 +1743,345 @@ public:
 		return true;
 	}
 
-	bool subsample(const GFile& srcfile, const size_t subsamplerate, std::vector<std::string> include_varnames, std::vector<std::string> exclude_varnames)
+	bool subsample(const GFile& srcfile, const size_t subsamplerate, std::vector<std::string> include_varnames, std::vector<std::string> exclude_varnames)
+	{
+		GIOScope scope(srcfile.getId(), "subsample");
+		unsigned int nsnew = (unsigned int)std::ceil((double)srcfile.ntotalsamples() / (double)subsamplerate);
+
+		const auto srclineindex = srcfile.get_line_index();
+		std::vector<unsigned int> ss_srclineindex(nsnew);
+		size_t k = 0;
+		for (size_t pi = 0; pi < nsnew; pi++) {
+			ss_srclineindex[pi] = srclineindex[k];
+			k += subsamplerate;
+		}
+		auto start = compute_start_from_line_index(ss_srclineindex);
+		auto count = compute_count_from_start(start, nsnew);
+
+		std::vector<unsigned int> linenumber(start.size());
+		for (size_t li = 0; li < start.size(); li++) {
+			linenumber[li] = srcfile.line_number[ss_srclineindex[start[li]]];
+		}
+
+		InitialiseNew(linenumber, count);
+
+		auto dm = srcfile.getDims();
+		for (auto dit = dm.begin(); dit != dm.end(); dit++) {
+			NcDim& srcdim = dit->second;
+			const std::string dimname = srcdim.getName();
+			if (hasDim(dimname)) continue;
+			else {
+				addDim(dimname, srcdim.getSize());
+			}
+		}
+
+		copy_global_atts(srcfile);
+		auto vm = srcfile.getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			NcVar& srcvar = vit->second;
+			const std::string vname = srcvar.getName();
+			if (vname == VN_LI_START) continue;
+			if (vname == VN_LI_COUNT) continue;
+			if (vname == DN_POINT) continue;
+
+			bool incstatus = isinlist(include_varnames, vname);
+			bool excstatus = isinlist(exclude_varnames, vname);
+
+			bool status = true;
+			if (include_varnames.size() > 0 && incstatus == false) {
+				status = false;
+			}
+
+			if (exclude_varnames.size() > 0 && excstatus == true) {
+				status = false;
+			}
+
+			if (status) {
+				copy_var(subsamplerate, srcvar);
+			}
+		}
+		return true;
+	}
+
+	//Create this new file from only the samples of srcfile in a selection, see select().
+	//Lines with no selected samples are dropped, line variables are kept for the remaining lines.
+	bool subsample(const GFile& srcfile, const GSelection& selection, std::vector<std::string> include_varnames, std::vector<std::string> exclude_varnames)
+	{
+		GIOScope scope(srcfile.getId(), "subsample");
+		std::vector<unsigned int> linenumber;
+		std::vector<unsigned int> count;
+		for (const GSelection::cLine& l : selection.Lines) {
+			linenumber.push_back(srcfile.line_number[l.lineindex]);
+			count.push_back((unsigned int)l.mask.count());
+		}
+		InitialiseNew(linenumber, count);
+		copy_dims(srcfile);
+		copy_global_atts(srcfile);
+
+		std::vector<uint8_t> buf;
+		auto vm = srcfile.getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			NcVar& srcvar = vit->second;
+			const std::string vname = srcvar.getName();
+			if (merge_skip(vname)) continue;
+			if (include_varnames.size() > 0 && isinlist(include_varnames, vname) == false) continue;
+			if (exclude_varnames.size() > 0 && isinlist(exclude_varnames, vname) == true) continue;
+
+			if (srcfile.isSampleVar(srcvar)) {
+				merge_define_var(srcvar);
+				NcVar dstvar = getVar(vname);
+				std::vector<NcDim> dims = srcvar.getDims();
+				std::vector<size_t> start(dims.size(), 0);
+				std::vector<size_t> count(dims.size());
+				size_t rowbytes = srcvar.getType().getSize();
+				for (size_t i = 1; i < dims.size(); i++) {
+					count[i] = dims[i].getSize();
+					rowbytes *= count[i];
+				}
+
+				//Gather the runs of each line and write the line with one call
+				for (size_t i = 0; i < selection.Lines.size(); i++) {
+					const GSelection::cLine& l = selection.Lines[i];
+					const size_t first = srcfile.get_line_index_start(l.lineindex);
+					buf.resize(l.mask.count() * rowbytes);
+					size_t k = 0;
+					for (const auto& r : l.mask.runs()) {
+						start[0] = first + r.first;
+						count[0] = r.second;
+						srcvar.getVar(start, count, (void*)&buf[k]);
+						k += r.second * rowbytes;
+					}
+					start[0] = get_line_index_start(i);
+					count[0] = get_line_index_count(i);
+					dstvar.putVar(start, count, (const void*)buf.data());
+				}
+			}
+			else if (srcfile.isLineVar(srcvar)) {
+				merge_define_var(srcvar);
+				NcVar dstvar = getVar(vname);
+				for (size_t i = 0; i < selection.Lines.size(); i++) {
+					copy_var_rows(srcvar, dstvar, selection.Lines[i].lineindex, i, 1, buf);
+				}
+			}
+			else {
+				copy_var(1, srcvar);
+			}
+		}
+		return true;
+	}
+
+	//Concatenate the lines of several files into this newly created file.
+	//All sources must have the same variables with the same types and non point/line dimensions.
+	//Variable data is streamed in blocks of whole chunks so no full variable is ever buffered.
+	//If renumber is true, lines whose numbers clash with an earlier line are given new numbers above the largest in use.
+	bool merge(const std::vector<std::string>& srcpaths, const bool renumber = false)
+	{
+		GIOScope scope(getId(), "merge");
+		if (srcpaths.size() == 0) return false;
+
+		std::vector<unsigned int> linenumber;
+		std::vector<unsigned int> count;
+		std::vector<size_t> lineoffset(srcpaths.size());
+		std::vector<size_t> sampleoffset(srcpaths.size());
+		std::map<std::string, std::string> schema;
+		size_t ns = 0;
+		for (size_t fi = 0; fi < srcpaths.size(); fi++) {
+			GFile src(srcpaths[fi], NcFile::read);
+			lineoffset[fi] = linenumber.size();
+			sampleoffset[fi] = ns;
+			for (size_t li = 0; li < src.nlines(); li++) {
+				linenumber.push_back(src.line_number[li]);
+				count.push_back(src.line_index_count[li]);
+				ns += src.line_index_count[li];
+			}
+
+			std::map<std::string, std::string> s = merge_schema(src);
+			if (fi == 0) schema = s;
+			else if (s != schema) {
+				std::string msg = _SRC_ + strprint("\nCannot merge (%s) as its variables do not match those of (%s)\n", srcpaths[fi].c_str(), srcpaths[0].c_str());
+				throw(std::exception(msg.c_str()));
+			}
+		}
+
+		if (renumber) {
+			unsigned int next = linenumber.size() ? *std::max_element(linenumber.begin(), linenumber.end()) + 1 : 0;
+			std::set<unsigned int> used;
+			for (size_t li = 0; li < linenumber.size(); li++) {
+				if (used.insert(linenumber[li]).second == false) {
+					linenumber[li] = next++;
+					used.insert(linenumber[li]);
+				}
+			}
+		}
+
+		InitialiseNew(linenumber, count);
+
+		std::vector<uint8_t> buf;
+		for (size_t fi = 0; fi < srcpaths.size(); fi++) {
+			GFile src(srcpaths[fi], NcFile::read);
+			if (fi == 0) {
+				copy_global_atts(src);
+				copy_dims(src);
+			}
+
+			auto vm = src.getVars();
+			for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+				const NcVar& srcvar = vit->second;
+				const std::string vname = srcvar.getName();
+				if (merge_skip(vname)) continue;
+				if (fi == 0) merge_define_var(srcvar);
+
+				NcVar dstvar = getVar(vname);
+				if (src.isSampleVar(srcvar)) {
+					copy_var_rows(srcvar, dstvar, 0, sampleoffset[fi], src.ntotalsamples(), buf);
+				}
+				else if (src.isLineVar(srcvar)) {
+					copy_var_rows(srcvar, dstvar, 0, lineoffset[fi], src.nlines(), buf);
+				}
+				else if (fi == 0 && srcvar.getDimCount() > 0) {
+					copy_var_rows(srcvar, dstvar, 0, 0, srcvar.getDim(0).getSize(), buf);
+				}
+			}
+		}
+		return true;
+	}
+
+	//Number of rows of the first dimension to copy at a time, a whole number of chunks of about 1MB
+	static size_t copy_block_rows(const NcVar& var)
 	{
-		unsigned int nsnew = (unsigned int)std::ceil((double)srcfile.ntotalsamples() / (double)subsamplerate);
+		std::vector<NcDim> dims = var.getDims();
+		size_t rowbytes = var.getType().getSize();
+		for (size_t i = 1; i < dims.size(); i++) rowbytes *= dims[i].getSize();
+		if (rowbytes == 0) return 1;
 
-		const auto srclineindex = srcfile.get_line_index();
-		std::vector<unsigned int> ss_srclineindex(nsnew);
-		size_t k = 0;
-		for (size_t pi = 0; pi < nsnew; pi++) {
-			ss_srclineindex[pi] = srclineindex[k];
-			k += subsamplerate;
+		size_t chunkrows = 1;
+		NcVar::ChunkMode mode;
+		std::vector<size_t> chunksizes;
+		var.getChunkingParameters(mode, chunksizes);
+		if (mode == NcVar::nc_CHUNKED && chunksizes.size() > 0 && chunksizes[0] > 0) {
+			chunkrows = chunksizes[0];
 		}
-		auto start = compute_start_from_line_index(ss_srclineindex);
-		auto count = compute_count_from_start(start, nsnew);
+		const size_t nchunks = std::max((size_t)1, ((size_t)1 << 20) / (chunkrows * rowbytes));
+		return chunkrows * nchunks;
+	}
 
-		std::vector<unsigned int> linenumber(start.size());
-		for (size_t li = 0; li < start.size(); li++) {
-			linenumber[li] = srcfile.line_number[ss_srclineindex[start[li]]];
-		}
+	//Copy rows [srcrow, srcrow+nrows) of the first dimension of srcvar to dstvar starting at row dstrow.
+	//String variables are copied string by string, variable length types are not supported.
+	static void copy_var_rows(const NcVar& srcvar, const NcVar& dstvar, const size_t srcrow, const size_t dstrow, const size_t nrows, std::vector<uint8_t>& buf)
+	{
+		std::vector<NcDim> dims = srcvar.getDims();
+		const size_t nd = dims.size();
+		if (nd == 0) return;
 
-		InitialiseNew(linenumber, count);
+		const nc_type typeclass = srcvar.getType().getTypeClass();
+		if (typeclass == NC_VLEN) {
+			std::string msg = _SRC_ + strprint("\nCannot copy rows of variable length variable (%s)\n", srcvar.getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		const bool isstring = (typeclass == NC_STRING);
 
-		auto dm = srcfile.getDims();
-		for (auto dit = dm.begin(); dit != dm.end(); dit++) {
-			NcDim& srcdim = dit->second;
-			const std::string dimname = srcdim.getName();
-			if (hasDim(dimname)) continue;
+		std::vector<size_t> start(nd, 0);
+		std::vector<size_t> dstart(nd, 0);
+		std::vector<size_t> count(nd);
+		size_t rowbytes = srcvar.getType().getSize();
+		for (size_t i = 1; i < nd; i++) {
+			count[i] = dims[i].getSize();
+			rowbytes *= count[i];
+		}
+
+		GIOScope scope(srcvar, "copy_var_rows");
+		scope.count(nrows * (rowbytes / srcvar.getType().getSize()), nrows * rowbytes);
+		const size_t blockrows = copy_block_rows(srcvar);
+		for (size_t r = 0; r < nrows; r += blockrows) {
+			const size_t n = std::min(blockrows, nrows - r);
+			start[0] = srcrow + r;
+			dstart[0] = dstrow + r;
+			count[0] = n;
+			buf.resize(n * rowbytes);
+			GTraceScope trace("copy block", start[0]);
+			srcvar.getVar(start, count, (void*)buf.data());
+			if (isstring) {
+				//buf holds char* allocated by netCDF, put copies the strings then they must be freed
+				char** strings = (char**)buf.data();
+				const size_t nstrings = buf.size() / sizeof(char*);
+				try {
+					dstvar.putVar(dstart, count, (const char**)strings);
+				}
+				catch (...) {
+					nc_free_string(nstrings, strings);
+					throw;
+				}
+				nc_free_string(nstrings, strings);
+			}
 			else {
-				addDim(dimname, srcdim.getSize());
+				dstvar.putVar(dstart, count, (const void*)buf.data());
 			}
 		}
+	}
 
-		copy_global_atts(srcfile);
-		auto vm = srcfile.getVars();
-		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
-			NcVar& srcvar = vit->second;
-			const std::string vname = srcvar.getName();
-			if (vname == VN_LI_START) continue;
-			if (vname == VN_LI_COUNT) continue;
-			if (vname == DN_POINT) continue;
+private:
 
-			bool incstatus = isinlist(include_varnames, vname);
-			bool excstatus = isinlist(exclude_varnames, vname);
+	static bool merge_skip(const std::string& vname)
+	{
+		if (vname == VN_LI_START) return true;
+		if (vname == VN_LI_COUNT) return true;
+		if (vname == VN_LINE_INDEX) return true;
+		if (vname == DN_POINT) return true;
+		if (vname == DN_LINE) return true;
+		return false;
+	}
 
-			bool status = true;
-			if (include_varnames.size() > 0 && incstatus == false) {
-				status = false;
+	//Signature of each variable's type and dimensions, ignoring the sizes of the point and line dimensions
+	static std::map<std::string, std::string> merge_schema(const GFile& src)
+	{
+		std::map<std::string, std::string> schema;
+		auto vm = src.getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			const NcVar& v = vit->second;
+			if (merge_skip(v.getName())) continue;
+			std::string sig = v.getType().getName();
+			std::vector<NcDim> dims = v.getDims();
+			for (size_t di = 0; di < dims.size(); di++) {
+				const std::string dname = dims[di].getName();
+				sig += " " + dname;
+				if (dname != DN_POINT && dname != DN_LINE) {
+					sig += strprint("=%zu", dims[di].getSize());
+				}
 			}
+			schema[v.getName()] = sig;
+		}
+		return schema;
+	}
 
-			if (exclude_varnames.size() > 0 && excstatus == true) {
-				status = false;
-			}
+	//Define a variable like srcvar with the same attributes, chunking and compression
+	void merge_define_var(const NcVar& srcvar)
+	{
+		std::vector<NcDim> dims = srcvar.getDims();
+		for (size_t di = 0; di < dims.size(); di++) {
+			dims[di] = getDim(dims[di].getName());
+		}
+		NcVar v = addVar(srcvar.getName(), srcvar.getType(), dims);
 
-			if (status) {
-				copy_var(subsamplerate, srcvar);
+		if (dims.size() > 0) {
+			NcVar::ChunkMode mode;
+			std::vector<size_t> chunksizes;
+			srcvar.getChunkingParameters(mode, chunksizes);
+			if (mode == NcVar::nc_CHUNKED) {
+				v.setChunking(mode, chunksizes);
 			}
+			bool shuffle, deflate;
+			int level;
+			srcvar.getCompressionParameters(shuffle, deflate, level);
+			if (deflate) v.setCompression(shuffle, deflate, level);
 		}
-		return true;
+		copy_varatts(srcvar, v);
 	}
 
+public:
+
 #ifdef ENABLE_GDAL
 	//Convert legacy file
-	bool convert_legacy(const cGeophysicsNcFile& srcfile)
+	bool convert_legacy(const GFile& srcfile)
 	{
 		InitialiseNew(srcfile.line_number, srcfile.line_index_count);
 		copy_global_atts(srcfile);
@@ -1028,7 +2114,7 @@ public:
 				}
 
 				//Remove units = "1"				
-				if (cGeophysicsVar::hasAtt(v, AN_UNITS)) {
+				if (GVar::hasAtt(v, AN_UNITS)) {
 					NcVarAtt a = v.getAtt(AN_UNITS);
 					if (!a.isNull()) {
 						std::string units;
@@ -1109,6 +2195,8 @@ public:
 		size_t elementsize = v.getType().getSize();
 		size_t bufsize = nelements * elementsize;
 		if (bufsize > 0) {
+			GIOScope scope(srcvar, "copy_var");
+			scope.count(nelements, bufsize);
 			std::vector<uint8_t> buf(bufsize);
 			srcvar.getVar(start, count, stride, (void*)buf.data());
 			v.putVar(start, count, stride_out, (void*)buf.data());
@@ -1136,6 +2224,78 @@ public:
 	size_t ntotalsamples() const { return sum(line_index_count); }
 	size_t nlinesamples(const size_t lineindex) const { return line_index_count[lineindex]; }
 
+	//Cost model for reading the named sample variables, in bytes. Each segment costs one read
+	//call per variable, taken to be worth callbytes, so multiband variables weigh by their bands.
+	cPartitionCost partition_cost(const std::vector<std::string>& varnames, const double callbytes = 65536.0) const {
+		cPartitionCost c;
+		c.persample = 0.0;
+		for (const std::string& name : varnames) {
+			const GSampleVar v(*this, getVar(name));
+			c.persample += (double)(v.elementspersample() * v.getType().getSize());
+			c.persegment += callbytes;
+		}
+		return c;
+	}
+
+	//Split the samples [0, ntotalsamples()) into nparts contiguous pieces of about equal cost.
+	//With splitlines=false pieces only break at line boundaries, otherwise they may break inside
+	//a line, so long lines no longer decide the balance. Every line appears in exactly one piece
+	//unless it is split, lines with no samples give a segment with count 0. Pieces may be empty
+	//when there are more pieces than lines.
+	std::vector<GPartition> partition(const size_t nparts, const bool splitlines = false, const cPartitionCost& model = cPartitionCost()) const {
+		if (nparts == 0) {
+			std::string msg = _SRC_ + strprint("\nCannot partition into zero pieces\n");
+			throw(std::exception(msg.c_str()));
+		}
+
+		//Cumulative cost at the start of each line
+		const size_t nl = nlines();
+		const size_t ns = ntotalsamples();
+		std::vector<double> cum(nl + 1, 0.0);
+		for (size_t li = 0; li < nl; li++) cum[li + 1] = cum[li] + model.cost(line_index_count[li]);
+
+		//Sample index of the start of each piece
+		std::vector<size_t> cut(nparts + 1, ns);
+		cut[0] = 0;
+		for (size_t k = 1; k < nparts; k++) {
+			const double target = cum[nl] * (double)k / (double)nparts;
+			size_t li = (size_t)(std::upper_bound(cum.begin(), cum.end(), target) - cum.begin());
+			li = li > 0 ? li - 1 : 0;
+			if (li >= nl) {
+				cut[k] = ns;
+			}
+			else if (splitlines && model.persample > 0.0) {
+				const double f = (target - cum[li] - model.persegment) / model.persample;
+				const size_t offset = (size_t)std::llround(std::max(0.0, std::min(f, (double)line_index_count[li])));
+				cut[k] = line_index_start[li] + offset;
+			}
+			else {
+				//Nearest line boundary
+				const size_t b = (target - cum[li] <= cum[li + 1] - target) ? li : li + 1;
+				cut[k] = b < nl ? line_index_start[b] : ns;
+			}
+			cut[k] = std::max(cut[k], cut[k - 1]);
+		}
+
+		std::vector<GPartition> parts(nparts);
+		size_t p = 0;
+		for (size_t li = 0; li < nl; li++) {
+			const size_t s = line_index_start[li];
+			const size_t e = s + line_index_count[li];
+			while (p + 1 < nparts && cut[p + 1] <= s) p++;
+			if (s == e) {
+				parts[p].Segments.push_back({ li, 0, 0 });
+				continue;
+			}
+			for (size_t q = p; q < nparts && cut[q] < e; q++) {
+				const size_t a = std::max(s, cut[q]);
+				const size_t b = std::min(e, cut[q + 1]);
+				if (b > a) parts[q].Segments.push_back({ li, a - s, b - a });
+			}
+		}
+		return parts;
+	}
+
 	size_t getLineIndexByPointIndex(const int& pointindex) const
 	{
 		const size_t n = line_index_start.size() - 1;
@@ -1279,6 +2439,43 @@ public:
 		return true;
 	}
 
+	//Read a segment of a partition, all bands, sample major
+	template<typename T>
+	bool getDataBySegment(const std::string& varname, const GSegment& segment, std::vector<T>& vals) {
+		GIOScope scope(getId(), "getDataBySegment", varname);
+		if (hasDerivedVar(varname)) {
+			std::vector<double> d;
+			size_t nbands;
+			getDerivedVar(varname)->getLine(*this, segment.lineindex, d, nbands);
+			const auto first = d.begin() + segment.offset * nbands;
+			std::vector<double> part(first, first + segment.count * nbands);
+			copy_nan_as_fill(part, vals);
+			return true;
+		}
+		GSampleVar var = getSampleVar(varname);
+		return var.getSegment(segment, vals);
+	}
+
+	//Read every stride'th sample of a line, all bands, sample major
+	template<typename T>
+	bool getDataByLineIndexStrided(const std::string& varname, const size_t& lineindex, const size_t& stride, std::vector<T>& vals) {
+		GIOScope scope(getId(), "getDataByLineIndexStrided", varname);
+		if (hasDerivedVar(varname)) {
+			std::vector<double> d;
+			size_t nbands;
+			getDerivedVar(varname)->getLine(*this, lineindex, d, nbands);
+			const size_t s = std::max((size_t)1, stride);
+			std::vector<double> picked;
+			for (size_t i = 0; nbands > 0 && i < d.size(); i += s * nbands) {
+				picked.insert(picked.end(), d.begin() + i, d.begin() + i + nbands);
+			}
+			copy_nan_as_fill(picked, vals);
+			return true;
+		}
+		GSampleVar var = getSampleVar(varname);
+		return var.getLineStrided(lineindex, stride, vals);
+	}
+
 	template<typename T>
 	bool getDataByLineNumber(const std::string& varname, const size_t& linenumber, std::vector<T>& vals) {
 		size_t index = getLineIndex(linenumber);
@@ -1288,12 +2485,35 @@ public:
 
 	template<typename T>
 	bool getDataByLineIndex(const std::string& varname, const size_t& lineindex, std::vector<T>& vals) {
+		GIOScope scope(getId(), "getDataByLineIndex", varname);
+		if (hasDerivedVar(varname)) {
+			std::vector<double> d;
+			size_t nbands;
+			getDerivedVar(varname)->getLine(*this, lineindex, d, nbands);
+			copy_nan_as_fill(d, vals);
+			return true;
+		}
 		GSampleVar var = getSampleVar(varname);
 		return getDataByLineIndex(var, lineindex, vals);
 	}
 
 	template<typename T>
 	bool getDataByLineIndex(const std::string& varname, const size_t& lineindex, std::vector<std::vector<T>>& vals) {
+		GIOScope scope(getId(), "getDataByLineIndex", varname);
+		if (hasDerivedVar(varname)) {
+			std::vector<double> d;
+			size_t nbands;
+			getDerivedVar(varname)->getLine(*this, lineindex, d, nbands);
+			const size_t nsamples = nbands ? d.size() / nbands : 0;
+			vals.resize(nbands);
+			for (size_t bi = 0; bi < nbands; bi++) {
+				std::vector<double> band(nsamples);
+				for (size_t si = 0; si < nsamples; si++) band[si] = d[si * nbands + bi];
+				copy_nan_as_fill(band, vals[bi]);
+			}
+			return true;
+		}
+
 		NcVar var = NcFile::getVar(varname);
 		std::vector<NcDim> dims = var.getDims();
 		size_t nd = dims.size();
@@ -1317,8 +2537,290 @@ public:
 		return true;
 	}
 
+	//Define a derived variable from an expression over existing variables, e.g. "height - dem"
+	bool addDerivedVar(const std::string& name, const std::string& expression, const size_t cachelines = 0) {
+		return addDerivedVar(std::make_shared<GDerivedVar>(name, expression, cachelines));
+	}
+
+	//Define a derived variable computed by a C++ callable from the named input variables
+	bool addDerivedVar(const std::string& name, const std::vector<std::string>& inputs, const GDerivedVar::Function& f, const size_t cachelines = 0) {
+		return addDerivedVar(std::make_shared<GDerivedVar>(name, inputs, f, cachelines));
+	}
+
+	//Inputs must already exist, so derived variables can never depend on themselves
+	bool addDerivedVar(const std::shared_ptr<GDerivedVar>& d) {
+		const std::string& name = d->getName();
+		if (hasVar(name) || hasDerivedVar(name)) return false;
+		for (const std::string& in : d->inputs()) {
+			if (hasVar(in) == false && hasDerivedVar(in) == false) {
+				std::string msg = _SRC_ + strprint("\nInput variable (%s) of derived variable (%s) does not exist\n", in.c_str(), name.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+		}
+		DerivedVars[name] = d;
+		return true;
+	}
+
+	bool hasDerivedVar(const std::string& name) const {
+		return DerivedVars.find(name) != DerivedVars.end();
+	}
+
+	std::shared_ptr<GDerivedVar> getDerivedVar(const std::string& name) const {
+		auto it = DerivedVars.find(name);
+		if (it == DerivedVars.end()) return std::shared_ptr<GDerivedVar>();
+		return it->second;
+	}
+
+	bool removeDerivedVar(const std::string& name) {
+		return DerivedVars.erase(name) > 0;
+	}
+
+	//Read one line of a stored or derived variable as double with nulls as NaN.
+	//Line variables are repeated for every sample in the line.
+	bool getLineAsDouble(const std::string& name, const size_t& lineindex, std::vector<double>& vals, size_t& nbands) {
+		if (hasDerivedVar(name)) {
+			return getDerivedVar(name)->getLine(*this, lineindex, vals, nbands);
+		}
+
+		GVar v = getGeophysicsVar(name);
+		if (v.isNull()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to read variable (%s)\n", name.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		nbands = v.elementspersample();
+		v.getLineMapped(lineindex, vals);
+		if (v.isLineVar()) {
+			const size_t ns = nlinesamples(lineindex);
+			std::vector<double> rec(vals);
+			vals.resize(ns * nbands);
+			for (size_t si = 0; si < ns; si++) {
+				std::copy(rec.begin(), rec.end(), vals.begin() + si * nbands);
+			}
+		}
+		return true;
+	}
+
+	//Name of the line variable holding the per-line minimum or maximum of a sample variable, see addLineSummaries()
+	static std::string summary_name(const std::string& varname, const bool max) {
+		return varname + (max ? "_line_max" : "_line_min");
+	}
+
+	//Name of the line variable holding the per-line number of null samples of a sample variable
+	static std::string summary_nnull_name(const std::string& varname) {
+		return varname + "_line_nnull";
+	}
+
+	//Store the per-line minimum, maximum and number of nulls of a single band sample variable as line variables.
+	//select() uses them to skip lines where a predicate cannot be true.
+	bool addLineSummaries(const std::string& varname) {
+		GVar v = getGeophysicsVar(varname);
+		if (v.isNull() || v.isSampleVar() == false || v.elementspersample() != 1) {
+			std::string msg = _SRC_ + strprint("\nLine summaries can only be added for a single band sample variable (%s)\n", varname.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		std::vector<double> lmin(nlines(), nan);
+		std::vector<double> lmax(nlines(), nan);
+		std::vector<unsigned int> lnull(nlines(), 0);
+		std::vector<double> vals;
+		for (size_t li = 0; li < nlines(); li++) {
+			v.getLineMapped(li, vals);
+			double mn = std::numeric_limits<double>::infinity();
+			double mx = -mn;
+			for (size_t i = 0; i < vals.size(); i++) {
+				if (vals[i] != vals[i]) {
+					lnull[li]++;
+					continue;
+				}
+				mn = std::min(mn, vals[i]);
+				mx = std::max(mx, vals[i]);
+			}
+			if (mn <= mx) {
+				lmin[li] = mn;
+				lmax[li] = mx;
+			}
+		}
+
+		for (const bool max : { false, true }) {
+			const std::string name = summary_name(varname, max);
+			if (hasVar(name) == false && addLineVar(name, ncDouble) == false) return false;
+			GLineVar sv = getLineVar(name);
+			std::vector<double> out(max ? lmax : lmin);
+			const double fill = sv.missingvalue(fill);
+			for (size_t li = 0; li < out.size(); li++) {
+				if (out[li] != out[li]) out[li] = fill;
+			}
+			sv.putAll(out);
+		}
+
+		const std::string name = summary_nnull_name(varname);
+		if (hasVar(name) == false && addLineVar(name, ncUint) == false) return false;
+		getLineVar(name).putAll(lnull);
+		return true;
+	}
+
+	//Select the samples for which a predicate such as "height > 120 && rms < 1.5" is true (non-zero).
+	//The predicate may use single band sample variables, line variables and derived variables.
+	//Sample variables are read and tested a block of whole chunks at a time, lines are processed
+	//concurrently by nthreads threads (0 = all cores). Lines whose summaries (see addLineSummaries())
+	//show that the predicate cannot be true for any sample are not read at all. Nulls are allowed for:
+	//a sample variable may be null in any line unless its null count summary says otherwise.
+	GSelection select(const std::string& predicate, const size_t nthreads = 0) {
+		GIOScope scope(getId(), "select");
+		const GExpression e(predicate);
+		const std::vector<std::string>& names = e.variables();
+		const size_t nv = names.size();
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		const double inf = std::numeric_limits<double>::infinity();
+
+		enum class eInput { sample, line, derived };
+		std::vector<eInput> kind(nv);
+		std::vector<GVar> vars;
+		std::vector<std::vector<double>> linevals(nv);//values of line variables
+		std::vector<std::vector<double>> summin(nv);
+		std::vector<std::vector<double>> summax(nv);
+		std::vector<std::vector<double>> sumnull(nv);//number of nulls in each line
+		size_t chunk = 1;
+		bool havebounds = false;
+		for (size_t vi = 0; vi < nv; vi++) {
+			vars.push_back(hasDerivedVar(names[vi]) ? GVar(*this, NcVar()) : getGeophysicsVar(names[vi]));
+			const GVar& v = vars.back();
+			if (hasDerivedVar(names[vi])) {
+				kind[vi] = eInput::derived;
+				continue;
+			}
+
+			if (v.isNull() || (v.isSampleVar() == false && v.isLineVar() == false) || v.elementspersample() != 1) {
+				std::string msg = _SRC_ + strprint("\nVariable (%s) in predicate \"%s\" must be a single band sample or line variable\n", names[vi].c_str(), predicate.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+
+			if (v.isLineVar()) {
+				kind[vi] = eInput::line;
+				linevals[vi].resize(nlines());
+				if (nlines()) v.getVarMapped({ 0 }, { nlines() }, linevals[vi].data(), nan);
+				summin[vi] = linevals[vi];
+				summax[vi] = linevals[vi];
+				continue;
+			}
+
+			kind[vi] = eInput::sample;
+			chunk = std::max(chunk, point_chunk_size(v));
+			const std::string smin = summary_name(names[vi], false);
+			const std::string smax = summary_name(names[vi], true);
+			if (nlines() && hasVar(smin) && hasVar(smax)) {
+				summin[vi].resize(nlines());
+				summax[vi].resize(nlines());
+				getGeophysicsVar(smin).getVarMapped({ 0 }, { nlines() }, summin[vi].data(), nan);
+				getGeophysicsVar(smax).getVarMapped({ 0 }, { nlines() }, summax[vi].data(), nan);
+				const std::string snull = summary_nnull_name(names[vi]);
+				if (hasVar(snull)) {
+					sumnull[vi].resize(nlines());
+					getGeophysicsVar(snull).getVarMapped({ 0 }, { nlines() }, sumnull[vi].data(), nan);
+				}
+				havebounds = true;
+			}
+		}
+		//Read blocks of whole chunks, at least a few thousand samples
+		const size_t block = ((4095 / chunk) + 1) * chunk;
+
+		std::vector<GSelection::cLine> result(nlines());
+		std::vector<uint8_t> pruned(nlines(), 0);
+		parallel_for(nlines(), [&](const size_t li) {
+			const size_t ns = nlinesamples(li);
+			if (ns == 0) return;
+
+			if (havebounds) {
+				std::vector<double> lo(nv, -inf);
+				std::vector<double> hi(nv, inf);
+				std::vector<uint8_t> maynull(nv, 1);
+				for (size_t vi = 0; vi < nv; vi++) {
+					if (summin[vi].size() == 0) continue;
+					//An all null line, or a null line variable, leaves the bounds open
+					if (summin[vi][li] != summin[vi][li] || summax[vi][li] != summax[vi][li]) continue;
+					lo[vi] = summin[vi][li];
+					hi[vi] = summax[vi][li];
+					if (kind[vi] == eInput::line) maynull[vi] = 0;
+					else if (sumnull[vi].size() && sumnull[vi][li] == 0.0) maynull[vi] = 0;
+				}
+				double elo, ehi;
+				e.evaluate_bounds(lo, hi, maynull, elo, ehi);
+				if (elo == 0.0 && ehi == 0.0) {
+					pruned[li] = 1;
+					return;
+				}
+			}
+
+			std::vector<std::vector<double>> buf(nv);
+			std::vector<std::vector<double>> derived(nv);
+			std::vector<const double*> inputs(nv);
+			std::vector<double> out;
+			GValidityMask mask;
+
+			const size_t first = get_line_index_start(li);
+			size_t s = 0;
+			while (s < ns) {
+				//Block boundaries are aligned to the chunks of the point dimension
+				const size_t e0 = ((first + s) / block + 1) * block;
+				const size_t n = std::min(ns - s, e0 - (first + s));
+				{
+					std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+					for (size_t vi = 0; vi < nv; vi++) {
+						if (kind[vi] == eInput::sample) {
+							buf[vi].resize(n);
+							vars[vi].getVarMapped({ first + s }, { n }, buf[vi].data(), nan);
+							inputs[vi] = buf[vi].data();
+						}
+						else if (kind[vi] == eInput::line) {
+							buf[vi].assign(n, linevals[vi][li]);
+							inputs[vi] = buf[vi].data();
+						}
+						else {
+							if (s == 0) {
+								size_t nb;
+								getLineAsDouble(names[vi], li, derived[vi], nb);
+								if (nb != 1) {
+									std::string msg = _SRC_ + strprint("\nVariable (%s) in predicate \"%s\" must be a single band variable\n", names[vi].c_str(), predicate.c_str());
+									throw(std::exception(msg.c_str()));
+								}
+							}
+							inputs[vi] = derived[vi].data() + s;
+						}
+					}
+				}
+				e.evaluate(inputs, n, out);
+				mask.append(GValidityMask(out.data(), n, 0.0));
+				s += n;
+			}
+
+			if (mask.any()) {
+				result[li].lineindex = li;
+				result[li].mask = std::move(mask);
+			}
+		}, nthreads);
+
+		GSelection sel;
+		sel.Predicate = predicate;
+		for (size_t li = 0; li < nlines(); li++) {
+			if (result[li].mask.size() > 0) sel.Lines.push_back(std::move(result[li]));
+			sel.NLinesPruned += pruned[li];
+		}
+		return sel;
+	}
+
+	template<typename T>
+	static void copy_nan_as_fill(const std::vector<double>& src, std::vector<T>& dst) {
+		dst.resize(src.size());
+		const T fill = default_fill<T>();
+		for (size_t i = 0; i < src.size(); i++) {
+			dst[i] = (src[i] != src[i]) ? fill : (T)src[i];
+		}
+	}
+
 	template<typename T>
 	bool getDataByPointIndex(const std::string& varname, const size_t& pointindex, std::vector<T>& vals) {
+		GIOScope scope(getId(), "getDataByPointIndex", varname);
 		GVar var(*this, getVar(varname));
 		if (var.isNull()) {
 			std::string msg = _SRC_ + strprint("\nAttempt to read variable (%s)\n", varname.c_str());
@@ -1462,9 +2964,76 @@ public:
 		return GLineVar(*this, NcVar());
 	}
 
+	//Bind a compile-time schema (a GSchema<...> from geophysics_netcdf_schema.hpp) to this file.
+	//Every field is looked up and type checked once, here, rather than on each access.
+	template<typename S>
+	S bind() const {
+		return S(*this);
+	}
+
+
+	// Number of samples in a chunk of the point dimension, or a nominal size for contiguous variables
+	static size_t point_chunk_size(const NcVar& var)
+	{
+		NcVar::ChunkMode mode;
+		std::vector<size_t> chunksizes;
+		var.getChunkingParameters(mode, chunksizes);
+		if (mode == NcVar::nc_CHUNKED && chunksizes.size() > 0 && chunksizes[0] > 0) {
+			return chunksizes[0];
+		}
+		return 1024;
+	}
+
+	// Search samples [s,e) for the first (forward) or last non-null x/y pair.
+	// Windows are read from the line end, aligned to chunk boundaries, and doubled in width while they are all null.
+	// A value is null if it equals the variable's missing value or is NaN (the baseline only tested the missing value).
+	static bool findNonNullEdgePoint(const GVar& vx, const GVar& vy,
+		const size_t s, const size_t e, const size_t chunk, const bool forward, double& x, double& y)
+	{
+		thread_local std::vector<double> xb;
+		thread_local std::vector<double> yb;
+		size_t width = chunk;
+		size_t lo = s;
+		size_t hi = e;
+		while (lo < hi) {
+			size_t ws, we;
+			if (forward) {
+				ws = lo;
+				we = std::min(hi, (ws / chunk) * chunk + width);
+				lo = we;
+			}
+			else {
+				we = hi;
+				const size_t top = ((we - 1) / chunk + 1) * chunk;
+				ws = top > width ? std::max(lo, top - width) : lo;
+				hi = ws;
+			}
+			const size_t n = we - ws;
+			xb.resize(n);
+			yb.resize(n);
+			{
+				std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+				vx.getVarMapped({ ws }, { n }, xb.data(), std::numeric_limits<double>::quiet_NaN());
+				vy.getVarMapped({ ws }, { n }, yb.data(), std::numeric_limits<double>::quiet_NaN());
+			}
+			GValidityMask valid = GValidityMask::from_nan(xb.data(), n);
+			valid &= GValidityMask::from_nan(yb.data(), n);
+			const size_t i = forward ? valid.first() : valid.last();
+			if (i != GValidityMask::npos) {
+				x = xb[i];
+				y = yb[i];
+				return true;
+			}
+			width *= 2;
+		}
+		return false;
+	}
 
+	// First and last non-null x/y pair of every line, the missing value where a line has none (see findNonNullEdgePoint()).
+	// Lines are scanned by nthreads threads (0 = all cores), but the reads hold netcdf_mutex() so only the
+	// null scanning runs in parallel, the I/O is serial.
 	bool findNonNullLineStartEndPoints(const std::string& xvar, const std::string& yvar,
-		std::vector<double>& x1, std::vector<double>& x2, std::vector<double>& y1, std::vector<double>& y2) {
+		std::vector<double>& x1, std::vector<double>& x2, std::vector<double>& y1, std::vector<double>& y2, const size_t nthreads = 0) {
 		x1.resize(nlines());
 		x2.resize(nlines());
 		y1.resize(nlines());
@@ -1474,46 +3043,31 @@ public:
 		GSampleVar vy = getSampleVar(yvar);
 		double nvx = vx.missingvalue(nvx);
 		double nvy = vy.missingvalue(nvy);
-		for (size_t li = 0; li < nlines(); li++) {
-			std::vector<double> x;
-			std::vector<double> y;
-			vx.getLine(li, x);
-			vy.getLine(li, y);
+		const size_t chunk = std::min(point_chunk_size(vx), point_chunk_size(vy));
 
-			const size_t ns = x.size();
+		parallel_for(nlines(), [&](const size_t li) {
+			const size_t s = line_index_start[li];
+			const size_t e = s + line_index_count[li];
 
 			x1[li] = nvx;
 			y1[li] = nvy;
-			for (size_t si = 0; si < ns; si++) {
-				if (x[si] != nvx && y[si] != nvy) {
-					x1[li] = x[si];
-					y1[li] = y[si];
-					break;
-				}
-			}
+			findNonNullEdgePoint(vx, vy, s, e, chunk, true, x1[li], y1[li]);
 
 			x2[li] = nvx;
 			y2[li] = nvy;
-			for (size_t si = ns - 1; ; si--) {
-				if (x[si] != nvx && y[si] != nvy) {
-					x2[li] = x[si];
-					y2[li] = y[si];
-					break;
-				}
-				if (si == 0)break;//avoid endless loop
-			}
-		}
+			findNonNullEdgePoint(vx, vy, s, e, chunk, false, x2[li], y2[li]);
+		}, nthreads);
 		return true;
 	}
 
 #ifdef ENABLE_GDAL
-	bool addCRS(const int epsgcode) {
+	bool addCRS(const int epsgcode, const std::string& varname = "crs") {
 
 #ifdef _WIN32 
-		NcVar v = NcFile::addVar("crs", ncByte);
+		NcVar v = NcFile::addVar(varname, ncByte);
 #else 			
 		std::vector<NcDim> d;
-		NcVar v = NcFile::addVar("crs", ncByte, d);
+		NcVar v = NcFile::addVar(varname, ncByte, d);
 #endif
 
 		v.putAtt(AN_LONG_NAME, "coordinate_reference_system");
@@ -1619,8 +3173,8 @@ public:
 		std::vector<double> y;
 		std::vector<double> px;
 		std::vector<double> py;
-		cSampleVar vx = getSampleVar(xvarname);
-		cSampleVar vy = getSampleVar(yvarname);
+		GSampleVar vx = getSampleVar(xvarname);
+		GSampleVar vy = getSampleVar(yvarname);
 		vx.getAll(x);
 		vy.getAll(y);
 		double nullx = vx.missingvalue(nullx);
@@ -1630,6 +3184,125 @@ public:
 			line_index_start, line_index_count,
 			x, y, nullx, nully, 64, px, py);
 
+		return add_bounding_polygon(px, py);
+	}
+
+	//As addAlphaShapePolygon() but streamed and in parallel. Consecutive lines are grouped into
+	//tiles of about tilesamples samples. Each tile's lines are read, thinned and reduced to the
+	//tile's own alpha shape polygon concurrently, holding only one tile per thread. The tile
+	//polygons are then merged by one alpha shape over their vertices.
+	//Along each line a sample closer than thindistance to the last one kept is dropped, the first
+	//and last samples are always kept. Every dropped sample is within thindistance of a kept one,
+	//so thinning moves the boundary by at most about thindistance. thindistance < 0 uses half the
+	//tile's mean line spacing (its extent area over its flown length), a change of at most about
+	//half a line spacing; 0 keeps every sample and leaves the shape unchanged.
+	bool addAlphaShapePolygonStreamed(const std::string xvarname, const std::string yvarname, const double thindistance = -1.0, const size_t tilesamples = 1000000, const size_t nthreads = 0) {
+		GIOScope scope(getId(), "addAlphaShapePolygonStreamed");
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+
+		//Tiles of whole consecutive lines, lines [tilestart[t], tilestart[t+1])
+		std::vector<size_t> tilestart = { 0 };
+		size_t n = 0;
+		for (size_t li = 0; li < nlines(); li++) {
+			n += nlinesamples(li);
+			if (n >= tilesamples && li + 1 < nlines()) {
+				tilestart.push_back(li + 1);
+				n = 0;
+			}
+		}
+		tilestart.push_back(nlines());
+		const size_t ntiles = tilestart.size() - 1;
+
+		std::vector<std::vector<double>> tx(ntiles);
+		std::vector<std::vector<double>> ty(ntiles);
+		parallel_for(ntiles, [&](const size_t t) {
+			GTraceScope trace("polygon tile", t);
+			const size_t l0 = tilestart[t];
+			const size_t l1 = tilestart[t + 1];
+			std::vector<std::vector<double>> lx(l1 - l0), ly(l1 - l0);
+			double xmin = std::numeric_limits<double>::infinity(), xmax = -xmin;
+			double ymin = xmin, ymax = -xmin;
+			double length = 0.0;
+			for (size_t li = l0; li < l1; li++) {
+				std::vector<double>& x = lx[li - l0];
+				std::vector<double>& y = ly[li - l0];
+				{
+					std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+					size_t nb;
+					getLineAsDouble(xvarname, li, x, nb);
+					getLineAsDouble(yvarname, li, y, nb);
+				}
+				size_t k = 0;
+				for (size_t si = 0; si < x.size(); si++) {
+					if (x[si] != x[si] || y[si] != y[si]) continue;
+					if (k > 0) length += std::hypot(x[si] - x[k - 1], y[si] - y[k - 1]);
+					x[k] = x[si];
+					y[k] = y[si];
+					k++;
+					xmin = std::min(xmin, x[si]); xmax = std::max(xmax, x[si]);
+					ymin = std::min(ymin, y[si]); ymax = std::max(ymax, y[si]);
+				}
+				x.resize(k);
+				y.resize(k);
+			}
+
+			double d = thindistance;
+			if (d < 0.0) d = length > 0.0 ? 0.5 * (xmax - xmin) * (ymax - ymin) / length : 0.0;
+			std::vector<unsigned int> start, count;
+			std::vector<double> x, y;
+			for (size_t i = 0; i < lx.size(); i++) {
+				start.push_back((unsigned int)x.size());
+				thin_line(lx[i], ly[i], d, x, y);
+				count.push_back((unsigned int)(x.size() - start.back()));
+				std::vector<double>().swap(lx[i]);
+				std::vector<double>().swap(ly[i]);
+			}
+			if (x.size() == 0) return;
+			line_data_alpha_shape_polygon_ch(start, count, x, y, nan, nan, 64, tx[t], ty[t]);
+		}, nthreads);
+
+		//Merge, each tile polygon is one "line" of vertices
+		std::vector<double> px;
+		std::vector<double> py;
+		if (ntiles == 1) {
+			px.swap(tx[0]);
+			py.swap(ty[0]);
+		}
+		else {
+			std::vector<unsigned int> start, count;
+			std::vector<double> x, y;
+			for (size_t t = 0; t < ntiles; t++) {
+				if (tx[t].size() == 0) continue;
+				start.push_back((unsigned int)x.size());
+				count.push_back((unsigned int)tx[t].size());
+				x.insert(x.end(), tx[t].begin(), tx[t].end());
+				y.insert(y.end(), ty[t].begin(), ty[t].end());
+			}
+			line_data_alpha_shape_polygon_ch(start, count, x, y, nan, nan, 64, px, py);
+		}
+		return add_bounding_polygon(px, py);
+	}
+
+private:
+
+	//Append the samples of a line (no nulls) keeping those at least d from the last one kept, and the last
+	static void thin_line(const std::vector<double>& x, const std::vector<double>& y, const double d, std::vector<double>& ox, std::vector<double>& oy) {
+		const size_t ns = x.size();
+		const double d2 = d * d;
+		size_t last = ns;
+		for (size_t si = 0; si < ns; si++) {
+			if (last < ns && si + 1 < ns) {
+				const double dx = x[si] - x[last];
+				const double dy = y[si] - y[last];
+				if (dx * dx + dy * dy < d2) continue;
+			}
+			ox.push_back(x[si]);
+			oy.push_back(y[si]);
+			last = si;
+		}
+	}
+
+	bool add_bounding_polygon(const std::vector<double>& px, const std::vector<double>& py) {
 		size_t nv = px.size();
 		std::vector<double> poly(nv * 2);
 		for (size_t i = 0; i < nv; i++) {
@@ -1641,13 +3314,15 @@ public:
 		dims.push_back(addDim("polygonvertex", nv));
 		dims.push_back(addDim("polygonordinate", 2));
 
-		cGeophysicsVar v(*this, addVar("bounding_polygon", ncDouble, dims));
+		GVar v(*this, addVar("bounding_polygon", ncDouble, dims));
 		v.add_long_name("bounding_polygon");
 		v.add_description("bounding polygon of survey");
 		v.add_units("degree");
 		v.putVar(poly.data());
 		return true;
 	}
+
+public:
 #endif
 
 	bool minmax(const std::string& varname, double& minval, double& maxval) {
@@ -1775,6 +3450,7 @@ public:
 	};
 
 	bool export_ASEGGDF2(const std::string& datfilepath, const std::string& dfnfilepath) {
+		GIOScope scope(getId(), "export_ASEGGDF2");
 		std::ofstream of(datfilepath);
 		of << std::fixed;
 
@@ -1794,7 +3470,6 @@ public:
 		}
 
 		const size_t nvars = vars.size(); // number of vars to be exported
-		std::vector<double>  mval(nvars); // missing value
 		std::vector<bool>    islv(nvars); // is it a line var
 		std::vector<cExportFormat> efmt(nvars);//format
 
@@ -1804,7 +3479,6 @@ public:
 
 			if (v.isLineVar()) islv[vi] = true;
 			else islv[vi] = false;
-			mval[vi] = v.missingvalue(double(0));
 			efmt[vi] = v.defaultexportformat();
 
 			int bands = (int)v.nbands();
@@ -1825,11 +3499,16 @@ public:
 			const size_t ns = line_index_count[li];
 
 			std::vector<andres::Marray<double>> A(nvars);
-			for (size_t vi = 0; vi < nvars; vi++) {
-				const GVar& v = vars[vi];
-				v.getLine(li, A[vi]);
+			{
+				GTraceScope trace("export read line", li);
+				for (size_t vi = 0; vi < nvars; vi++) {
+					//Nulls are replaced with the export null value as the line is read
+					const GVar& v = vars[vi];
+					v.getLineMapped(li, A[vi], efmt[vi].nullvalue);
+				}
 			}
 
+			GTraceScope trace("export format line", li);
 			for (size_t si = 0; si < ns; si += 100) {
 				for (size_t vi = 0; vi < nvars; vi++) {
 					const GVar& v = vars[vi];
@@ -1837,16 +3516,13 @@ public:
 					of << std::setprecision(efmt[vi].decimals);
 
 					const andres::Marray<double>& a = A[vi];
-					double val;
 					const size_t nb = v.nbands();
 
-					double* b;
+					const double* b;
 					if (islv[vi]) b = &(a(0));
-					else          b = &(a(si));
+					else          b = &(a(si * nb));
 					for (size_t bi = 0; bi < nb; bi++) {
-						val = b[bi];
-						if (val == mval[vi]) val = efmt[vi].nullvalue;
-						of << val;
+						of << b[bi];
 					}
 				}
 				of << std::endl;
@@ -1857,6 +3533,62 @@ public:
 
 };
 
+// Defined here only because it needs to be after GFile definition
+inline bool GDerivedVar::getLine(GFile& file, const size_t& lineindex, std::vector<double>& vals, size_t& nbands) const {
+	if (CacheLines > 0) {
+		std::lock_guard<std::mutex> lock(CacheMutex);
+		for (auto it = Cache.begin(); it != Cache.end(); it++) {
+			if (it->first == lineindex) {
+				vals = it->second;
+				nbands = NBands;
+				Cache.splice(Cache.begin(), Cache, it);
+				return true;
+			}
+		}
+	}
+
+	const size_t ns = file.nlinesamples(lineindex);
+	const size_t ni = Inputs.size();
+	std::vector<std::vector<double>> in(ni);
+	std::vector<size_t> nb(ni);
+	nbands = 1;
+	for (size_t i = 0; i < ni; i++) {
+		file.getLineAsDouble(Inputs[i], lineindex, in[i], nb[i]);
+		nbands = std::max(nbands, nb[i]);
+	}
+
+	//Repeat 1-band inputs across the bands of multiband inputs
+	std::vector<const double*> ptrs(ni);
+	for (size_t i = 0; i < ni; i++) {
+		if (nb[i] != nbands) {
+			if (nb[i] != 1) {
+				std::string msg = _SRC_ + strprint("\nInputs of derived variable (%s) have incompatible band counts\n", Name.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+			std::vector<double> r(ns * nbands);
+			for (size_t si = 0; si < ns; si++) {
+				std::fill(r.begin() + si * nbands, r.begin() + (si + 1) * nbands, in[i][si]);
+			}
+			in[i].swap(r);
+		}
+		ptrs[i] = in[i].data();
+	}
+
+	Evaluate(ptrs, ns, nbands, vals);
+	if (vals.size() != ns * nbands) {
+		std::string msg = _SRC_ + strprint("\nDerived variable (%s) returned the wrong number of values\n", Name.c_str());
+		throw(std::exception(msg.c_str()));
+	}
+
+	if (CacheLines > 0) {
+		std::lock_guard<std::mutex> lock(CacheMutex);
+		NBands = nbands;
+		Cache.emplace_front(lineindex, vals);
+		if (Cache.size() > CacheLines) Cache.pop_back();
+	}
+	return true;
+}
+
 // Defined here only because it needs to be after cGeophysicsNcFile definition
 inline size_t GVar::line_index_start(const size_t& index) const {
 	size_t start = Parent.get_line_index_start(index);
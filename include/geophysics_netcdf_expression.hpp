@@ -0,0 +1,420 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "string_utils.hpp"
+
+namespace GeophysicsNetCDF {
+
+// Small expression over named variables, e.g. "height - dem", "em_z / primary" or "height > 120 && rms < 1.5".
+// Supported: numbers, variable names, + - * / ^, unary minus, parentheses, the
+// functions abs sqrt exp log log10 sin cos min max pow, the comparisons
+// < <= > >= == != and the logical operators && || ! which give 1 (true) or 0 (false).
+// The expression is compiled once to postfix form and evaluated over whole arrays
+// an operation at a time, so each step is a simple loop that compilers vectorise.
+// Nulls should be passed in as NaN, they propagate through arithmetic and make comparisons false.
+class GExpression {
+
+public:
+
+	enum class eOp {
+		number, variable,
+		neg, add, sub, mul, div, pow,
+		abs, sqrt, exp, log, log10, sin, cos, min, max,
+		lt, le, gt, ge, eq, ne, logical_and, logical_or, logical_not
+	};
+
+	class cInstruction {
+	public:
+		eOp    op;
+		double value = 0.0;
+		size_t index = 0;//variable index
+	};
+
+private:
+
+	std::string Text;
+	std::vector<std::string>  Variables;
+	std::vector<cInstruction> Code;
+
+	//Parser state
+	size_t Pos = 0;
+
+	[[noreturn]] void syntax_error(const std::string& what) const {
+		std::string msg = _SRC_ + strprint("\nSyntax error in expression \"%s\" at position %zu: %s\n", Text.c_str(), Pos, what.c_str());
+		throw(std::exception(msg.c_str()));
+	}
+
+	void skipspace() {
+		while (Pos < Text.size() && std::isspace((unsigned char)Text[Pos])) Pos++;
+	}
+
+	bool accept(const char* token) {
+		skipspace();
+		const size_t n = std::char_traits<char>::length(token);
+		if (Text.compare(Pos, n, token) == 0) {
+			Pos += n;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(const char* token) {
+		if (accept(token) == false) syntax_error(std::string("expected ") + token);
+	}
+
+	void emit(const eOp op, const double value = 0.0, const size_t index = 0) {
+		cInstruction i;
+		i.op = op;
+		i.value = value;
+		i.index = index;
+		Code.push_back(i);
+	}
+
+	size_t variable_index(const std::string& name) {
+		for (size_t i = 0; i < Variables.size(); i++) {
+			if (Variables[i] == name) return i;
+		}
+		Variables.push_back(name);
+		return Variables.size() - 1;
+	}
+
+	static bool function_op(const std::string& name, eOp& op, size_t& nargs) {
+		struct { const char* name; eOp op; size_t nargs; } f[] = {
+			{"abs", eOp::abs, 1}, {"sqrt", eOp::sqrt, 1}, {"exp", eOp::exp, 1},
+			{"log", eOp::log, 1}, {"log10", eOp::log10, 1}, {"sin", eOp::sin, 1},
+			{"cos", eOp::cos, 1}, {"min", eOp::min, 2}, {"max", eOp::max, 2}, {"pow", eOp::pow, 2}
+		};
+		for (const auto& fi : f) {
+			if (name == fi.name) {
+				op = fi.op;
+				nargs = fi.nargs;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//Grammar, lowest precedence first
+	void parse_expression() { parse_or(); }
+
+	void parse_or() {
+		parse_and();
+		while (accept("||")) { parse_and(); emit(eOp::logical_or); }
+	}
+
+	void parse_and() {
+		parse_comparison();
+		while (accept("&&")) { parse_comparison(); emit(eOp::logical_and); }
+	}
+
+	void parse_comparison() {
+		parse_additive();
+		if (accept("<=")) { parse_additive(); emit(eOp::le); }
+		else if (accept(">=")) { parse_additive(); emit(eOp::ge); }
+		else if (accept("==")) { parse_additive(); emit(eOp::eq); }
+		else if (accept("!=")) { parse_additive(); emit(eOp::ne); }
+		else if (accept("<")) { parse_additive(); emit(eOp::lt); }
+		else if (accept(">")) { parse_additive(); emit(eOp::gt); }
+	}
+
+	void parse_additive() {
+		parse_multiplicative();
+		for (;;) {
+			if (accept("+")) { parse_multiplicative(); emit(eOp::add); }
+			else if (accept("-")) { parse_multiplicative(); emit(eOp::sub); }
+			else break;
+		}
+	}
+
+	void parse_multiplicative() {
+		parse_unary();
+		for (;;) {
+			if (accept("*")) { parse_unary(); emit(eOp::mul); }
+			else if (accept("/")) { parse_unary(); emit(eOp::div); }
+			else break;
+		}
+	}
+
+	void parse_unary() {
+		if (accept("-")) { parse_unary(); emit(eOp::neg); }
+		else if (accept("!")) { parse_unary(); emit(eOp::logical_not); }
+		else if (accept("+")) { parse_unary(); }
+		else parse_power();
+	}
+
+	void parse_power() {
+		parse_primary();
+		if (accept("^")) { parse_unary(); emit(eOp::pow); }
+	}
+
+	void parse_primary() {
+		skipspace();
+		if (Pos >= Text.size()) syntax_error("unexpected end");
+
+		const char c = Text[Pos];
+		if (accept("(")) {
+			parse_expression();
+			expect(")");
+			return;
+		}
+
+		if (std::isdigit((unsigned char)c) || c == '.') {
+			const char* begin = Text.c_str() + Pos;
+			char* end = nullptr;
+			const double v = std::strtod(begin, &end);
+			if (end == begin) syntax_error("bad number");
+			Pos += (size_t)(end - begin);
+			emit(eOp::number, v);
+			return;
+		}
+
+		if (std::isalpha((unsigned char)c) || c == '_') {
+			const size_t start = Pos;
+			while (Pos < Text.size() && (std::isalnum((unsigned char)Text[Pos]) || Text[Pos] == '_' || Text[Pos] == '.')) Pos++;
+			const std::string name = Text.substr(start, Pos - start);
+
+			eOp op;
+			size_t nargs;
+			if (function_op(name, op, nargs) && accept("(")) {
+				for (size_t ai = 0; ai < nargs; ai++) {
+					if (ai > 0) expect(",");
+					parse_expression();
+				}
+				expect(")");
+				emit(op);
+				return;
+			}
+			emit(eOp::variable, 0.0, variable_index(name));
+			return;
+		}
+		syntax_error(std::string("unexpected character '") + c + "'");
+	}
+
+	void compile(const std::string& text) {
+		Text = text;
+		Pos = 0;
+		Variables.clear();
+		Code.clear();
+		parse_expression();
+		skipspace();
+		if (Pos != Text.size()) syntax_error("unexpected trailing text");
+	}
+
+	template<typename F>
+	static void unary(std::vector<double>& a, F f) {
+		for (size_t i = 0; i < a.size(); i++) a[i] = f(a[i]);
+	}
+
+	template<typename F>
+	static void binary(std::vector<double>& a, const std::vector<double>& b, F f) {
+		for (size_t i = 0; i < a.size(); i++) a[i] = f(a[i], b[i]);
+	}
+
+	//Apply one operation to the top of the stack
+	void apply(const cInstruction& ins, std::vector<std::vector<double>>& stack, size_t& top) const {
+		std::vector<double>& a = stack[top - 1];
+		switch (ins.op) {
+		case eOp::neg: unary(a, [](double x) { return -x; }); return;
+		case eOp::abs: unary(a, [](double x) { return std::fabs(x); }); return;
+		case eOp::sqrt: unary(a, [](double x) { return std::sqrt(x); }); return;
+		case eOp::exp: unary(a, [](double x) { return std::exp(x); }); return;
+		case eOp::log: unary(a, [](double x) { return std::log(x); }); return;
+		case eOp::log10: unary(a, [](double x) { return std::log10(x); }); return;
+		case eOp::sin: unary(a, [](double x) { return std::sin(x); }); return;
+		case eOp::cos: unary(a, [](double x) { return std::cos(x); }); return;
+		case eOp::logical_not: unary(a, [](double x) { return (double)(x == 0.0); }); return;
+		default: break;
+		}
+
+		std::vector<double>& l = stack[top - 2];
+		switch (ins.op) {
+		case eOp::add: binary(l, a, [](double x, double y) { return x + y; }); break;
+		case eOp::sub: binary(l, a, [](double x, double y) { return x - y; }); break;
+		case eOp::mul: binary(l, a, [](double x, double y) { return x * y; }); break;
+		case eOp::div: binary(l, a, [](double x, double y) { return x / y; }); break;
+		case eOp::pow: binary(l, a, [](double x, double y) { return std::pow(x, y); }); break;
+		//NaN aware, a null in either argument gives a null
+		case eOp::min: binary(l, a, [](double x, double y) { return (x != x || y != y) ? x + y : (x < y ? x : y); }); break;
+		case eOp::max: binary(l, a, [](double x, double y) { return (x != x || y != y) ? x + y : (x > y ? x : y); }); break;
+		//Any comparison with a null (NaN) is false
+		case eOp::lt: binary(l, a, [](double x, double y) { return (double)(x < y); }); break;
+		case eOp::le: binary(l, a, [](double x, double y) { return (double)(x <= y); }); break;
+		case eOp::gt: binary(l, a, [](double x, double y) { return (double)(x > y); }); break;
+		case eOp::ge: binary(l, a, [](double x, double y) { return (double)(x >= y); }); break;
+		case eOp::eq: binary(l, a, [](double x, double y) { return (double)(x == y); }); break;
+		case eOp::ne: binary(l, a, [](double x, double y) { return (double)(x == x && y == y && x != y); }); break;
+		case eOp::logical_and: binary(l, a, [](double x, double y) { return (double)((x != 0.0 && x == x) & (y != 0.0 && y == y)); }); break;
+		case eOp::logical_or: binary(l, a, [](double x, double y) { return (double)((x != 0.0 && x == x) | (y != 0.0 && y == y)); }); break;
+		default: {
+			std::string msg = _SRC_ + strprint("\nUnsupported operation in expression \"%s\"\n", Text.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		}
+		top--;
+	}
+
+public:
+
+	GExpression() {};
+
+	explicit GExpression(const std::string& text) {
+		compile(text);
+	}
+
+	const std::string& text() const { return Text; }
+
+	//Names of the variables in order of first appearance, the order inputs are given to evaluate()
+	const std::vector<std::string>& variables() const { return Variables; }
+
+	const std::vector<cInstruction>& code() const { return Code; }
+
+	//Evaluate over n elements, inputs[i] holds n values of variables()[i]
+	void evaluate(const std::vector<const double*>& inputs, const size_t n, std::vector<double>& out) const {
+		if (inputs.size() != Variables.size()) {
+			std::string msg = _SRC_ + strprint("\nExpression \"%s\" was given the wrong number of inputs\n", Text.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+
+		thread_local std::vector<std::vector<double>> stack;
+		size_t top = 0;
+		for (const cInstruction& ins : Code) {
+			if (ins.op == eOp::number || ins.op == eOp::variable) {
+				if (stack.size() <= top) stack.resize(top + 1);
+				std::vector<double>& s = stack[top++];
+				if (ins.op == eOp::number) s.assign(n, ins.value);
+				else s.assign(inputs[ins.index], inputs[ins.index] + n);
+			}
+			else {
+				apply(ins, stack, top);
+			}
+		}
+		out.swap(stack[0]);
+	}
+
+	//Bounds [lo,hi] of the expression's value given bounds of each variable (in variables() order).
+	//Comparisons and logical operators give [1,1] if certainly true, [0,0] if certainly false,
+	//otherwise [0,1]. Used to rule out whole lines from their summaries without reading them.
+	//varnull[i] says variable i may also be null (NaN), a null compares false and ! of it is 0,
+	//so a result is only certainly true if no null can reach it. Empty varnull means no nulls.
+	void evaluate_bounds(const std::vector<double>& varlo, const std::vector<double>& varhi, const std::vector<uint8_t>& varnull, double& lo, double& hi) const {
+		const double inf = std::numeric_limits<double>::infinity();
+		std::vector<double> L, H;
+		std::vector<uint8_t> N;//the value may be null
+		for (const cInstruction& ins : Code) {
+			if (ins.op == eOp::number) { L.push_back(ins.value); H.push_back(ins.value); N.push_back(0); continue; }
+			if (ins.op == eOp::variable) {
+				L.push_back(varlo[ins.index]);
+				H.push_back(varhi[ins.index]);
+				N.push_back(varnull.size() ? varnull[ins.index] : 0);
+				continue;
+			}
+
+			double& al = L.back();
+			double& ah = H.back();
+			uint8_t& an = N.back();
+			switch (ins.op) {
+			case eOp::neg: { const double t = al; al = -ah; ah = -t; continue; }
+			case eOp::sqrt: if (al < 0.0) an = 1; al = std::sqrt(std::max(al, 0.0)); ah = std::sqrt(ah); finite(al, ah, an); continue;
+			case eOp::exp: al = std::exp(al); ah = std::exp(ah); continue;
+			case eOp::log: if (al < 0.0) an = 1; al = std::log(std::max(al, 0.0)); ah = std::log(ah); finite(al, ah, an); continue;
+			case eOp::log10: if (al < 0.0) an = 1; al = std::log10(std::max(al, 0.0)); ah = std::log10(ah); finite(al, ah, an); continue;
+			case eOp::sin: case eOp::cos: al = -1.0; ah = 1.0; continue;
+			case eOp::abs: {
+				const double l = al >= 0 ? al : (ah <= 0 ? -ah : 0.0);
+				ah = std::max(std::fabs(al), std::fabs(ah));
+				al = l;
+				continue;
+			}
+			case eOp::logical_not: truth(zero(al, ah) && an == 0, nonzero(al, ah), al, ah); an = 0; continue;
+			default: break;
+			}
+
+			const double bl = L.back(); L.pop_back();
+			const double bh = H.back(); H.pop_back();
+			const uint8_t bn = N.back(); N.pop_back();
+			double& xl = L.back();
+			double& xh = H.back();
+			uint8_t& xn = N.back();
+			const double ol = xl, oh = xh;
+			const uint8_t on = xn;
+			const bool nonull = (on == 0 && bn == 0);
+			xn = (on || bn) ? 1 : 0;
+			switch (ins.op) {
+			case eOp::add: xl = ol + bl; xh = oh + bh; finite(xl, xh, xn); break;
+			case eOp::sub: xl = ol - bh; xh = oh - bl; finite(xl, xh, xn); break;
+			case eOp::mul: {
+				const double p[4] = { ol * bl, ol * bh, oh * bl, oh * bh };
+				xl = std::min(std::min(p[0], p[1]), std::min(p[2], p[3]));
+				xh = std::max(std::max(p[0], p[1]), std::max(p[2], p[3]));
+				finite(xl, xh, xn);
+				break;
+			}
+			case eOp::div: {
+				//0/0 is null
+				if (bl <= 0.0 && bh >= 0.0) { xl = -inf; xh = inf; xn = 1; break; }
+				const double p[4] = { ol / bl, ol / bh, oh / bl, oh / bh };
+				xl = std::min(std::min(p[0], p[1]), std::min(p[2], p[3]));
+				xh = std::max(std::max(p[0], p[1]), std::max(p[2], p[3]));
+				finite(xl, xh, xn);
+				break;
+			}
+			case eOp::min: xl = std::min(ol, bl); xh = std::min(oh, bh); break;
+			case eOp::max: xl = std::max(ol, bl); xh = std::max(oh, bh); break;
+			case eOp::lt: truth(nonull && oh < bl, ol >= bh, xl, xh); xn = 0; break;
+			case eOp::le: truth(nonull && oh <= bl, ol > bh, xl, xh); xn = 0; break;
+			case eOp::gt: truth(nonull && ol > bh, oh <= bl, xl, xh); xn = 0; break;
+			case eOp::ge: truth(nonull && ol >= bh, oh < bl, xl, xh); xn = 0; break;
+			case eOp::eq: truth(nonull && ol == oh && bl == bh && ol == bl, oh < bl || ol > bh, xl, xh); xn = 0; break;
+			case eOp::ne: truth(nonull && (oh < bl || ol > bh), ol == oh && bl == bh && ol == bl, xl, xh); xn = 0; break;
+			case eOp::logical_and: truth(nonull && nonzero(ol, oh) && nonzero(bl, bh), zero(ol, oh) || zero(bl, bh), xl, xh); xn = 0; break;
+			case eOp::logical_or: truth((on == 0 && nonzero(ol, oh)) || (bn == 0 && nonzero(bl, bh)), zero(ol, oh) && zero(bl, bh), xl, xh); xn = 0; break;
+			default: xl = -inf; xh = inf; xn = 1; break;
+			}
+			if (xl != xl || xh != xh) { xl = -inf; xh = inf; xn = 1; }
+		}
+		lo = L.back();
+		hi = H.back();
+		if (lo != lo || hi != hi) { lo = -inf; hi = inf; }
+	}
+
+	//As above with no nulls
+	void evaluate_bounds(const std::vector<double>& varlo, const std::vector<double>& varhi, double& lo, double& hi) const {
+		evaluate_bounds(varlo, varhi, std::vector<uint8_t>(), lo, hi);
+	}
+
+private:
+
+	static bool zero(const double lo, const double hi) { return lo == 0.0 && hi == 0.0; }
+	static bool nonzero(const double lo, const double hi) { return lo > 0.0 || hi < 0.0; }
+
+	//Arithmetic on infinite bounds can give a null (eg inf - inf, 0 * inf)
+	static void finite(const double lo, const double hi, uint8_t& maynull) {
+		if (std::isinf(lo) || std::isinf(hi)) maynull = 1;
+	}
+
+	static void truth(const bool certainlytrue, const bool certainlyfalse, double& lo, double& hi) {
+		if (certainlytrue) { lo = 1.0; hi = 1.0; }
+		else if (certainlyfalse) { lo = 0.0; hi = 0.0; }
+		else { lo = 0.0; hi = 1.0; }
+	}
+
+public:
+};
+
+};//endname space
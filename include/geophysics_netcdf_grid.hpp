@@ -0,0 +1,407 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+enum class eGridMethod {
+	NEAREST,//value of the nearest sample within the search radius
+	IDW//inverse distance weighted mean of the samples within the search radius
+};
+
+enum class eGridFormat {
+	RAW,//ESRI float grid, a .flt file of 32 bit floats, north row first, and a .hdr text header
+	NETCDF//netCDF-4 file with x and y coordinate variables, south row first
+};
+
+class cGridOptions {
+public:
+	std::string xvar = "easting";
+	std::string yvar = "northing";
+	std::string var;//variable to grid
+	size_t band = 0;//band of a multiband variable
+	eGridMethod method = eGridMethod::IDW;
+	double cellsize = 100.0;
+	double radius = 0.0;//search radius, 0 for 2 cells
+	double power = 2.0;//IDW power
+	size_t maxpoints = 0;//IDW uses at most this many nearest samples, 0 for all in the radius
+	size_t nx = 0, ny = 0;//grid size, 0 to cover the data
+	double x0 = 0.0, y0 = 0.0;//lower left corner of the grid when nx and ny are given
+	float nullvalue = -99999.0f;
+	size_t tilecells = 256;//tiles of tilecells x tilecells cells are computed in parallel
+	size_t memorylimit = (size_t)1 << 30;//bytes of samples and grid rows held at once
+	size_t nthreads = 0;//0 for all cores
+};
+
+// Receives the rows of a grid as they are made, rows are numbered from the south
+class cGridWriter {
+public:
+	virtual ~cGridWriter() {}
+	virtual void put_rows(const size_t j0, const size_t nrows, const float* vals) = 0;
+	//Finish writing, errors are thrown here rather than lost in the destructor
+	virtual void close() {}
+};
+
+class cRawGridWriter : public cGridWriter {
+
+private:
+	FILE* fp = nullptr;
+	size_t NX, NY;
+	std::string Path;
+
+	[[noreturn]] void write_error() const {
+		std::string msg = _SRC_ + strprint("\nCould not write grid file (%s), the disk may be full\n", Path.c_str());
+		throw(std::exception(msg.c_str()));
+	}
+
+	void close_quietly() {
+		if (fp) fclose(fp);
+		fp = nullptr;
+	}
+
+	//64 bit offsets, long is 32 bits on Windows
+	static int seek(FILE* f, const uint64_t offset) {
+#ifdef _WIN32
+		return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+		return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+	}
+
+public:
+
+	cRawGridWriter(const std::string& path, const size_t nx, const size_t ny, const double x0, const double y0, const double cellsize, const float nullvalue)
+		: NX(nx), NY(ny)
+	{
+		Path = path;
+		const std::string base = path.substr(0, path.find_last_of('.') == std::string::npos ? path.size() : path.find_last_of('.'));
+		FILE* hp = fopen((base + ".hdr").c_str(), "w");
+		fp = fopen((base + ".flt").c_str(), "wb");
+		//The destructor does not run if the constructor throws, so fp is closed here
+		if (hp == nullptr || fp == nullptr) {
+			if (hp) fclose(hp);
+			close_quietly();
+			std::string msg = _SRC_ + strprint("\nCould not open grid file (%s) for writing\n", path.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		const int n = fprintf(hp, "ncols %zu\nnrows %zu\nxllcorner %.6f\nyllcorner %.6f\ncellsize %.6f\nNODATA_value %g\nbyteorder LSBFIRST\n", nx, ny, x0, y0, cellsize, nullvalue);
+		if (fclose(hp) != 0 || n < 0) {
+			close_quietly();
+			write_error();
+		}
+	}
+
+	~cRawGridWriter() {
+		close_quietly();
+	}
+
+	void put_rows(const size_t j0, const size_t nrows, const float* vals) {
+		for (size_t k = nrows; k-- > 0;) {
+			const size_t r = NY - 1 - (j0 + k);
+			if (seek(fp, (uint64_t)r * NX * sizeof(float)) != 0) write_error();
+			if (fwrite(vals + k * NX, sizeof(float), NX, fp) != NX) write_error();
+		}
+	}
+
+	void close() {
+		if (fp == nullptr) return;
+		const int status = fclose(fp);
+		fp = nullptr;
+		if (status != 0) write_error();
+	}
+};
+
+class cNcGridWriter : public cGridWriter {
+
+private:
+	NcFile File;
+	NcVar Var;
+	size_t NX;
+
+public:
+
+	cNcGridWriter(const std::string& path, const std::string& varname, const size_t nx, const size_t ny, const double x0, const double y0, const double cellsize, const float nullvalue)
+		: File(path, NcFile::replace), NX(nx)
+	{
+		NcDim dy = File.addDim("y", ny);
+		NcDim dx = File.addDim("x", nx);
+		NcVar vx = File.addVar("x", ncDouble, dx);
+		NcVar vy = File.addVar("y", ncDouble, dy);
+		std::vector<double> c(nx);
+		for (size_t i = 0; i < nx; i++) c[i] = x0 + ((double)i + 0.5) * cellsize;
+		if (nx) vx.putVar(c.data());
+		c.resize(ny);
+		for (size_t j = 0; j < ny; j++) c[j] = y0 + ((double)j + 0.5) * cellsize;
+		if (ny) vy.putVar(c.data());
+		Var = File.addVar(varname, ncFloat, std::vector<NcDim>{ dy, dx });
+		Var.putAtt("_FillValue", ncFloat, nullvalue);
+	}
+
+	void put_rows(const size_t j0, const size_t nrows, const float* vals) {
+		Var.putVar({ j0, (size_t)0 }, { nrows, NX }, vals);
+	}
+
+	void close() {
+		File.close();
+	}
+};
+
+// Grids one variable of a line data file.
+// Samples are streamed a line at a time and held in a spatial bin structure (bins of one
+// search radius) so each cell only visits nearby samples. The grid is made in strips of rows
+// chosen so that the samples a strip needs and its rows fit within memorylimit; when the whole
+// survey does not fit, each strip streams the file again. Within a strip, tiles of
+// tilecells x tilecells cells are computed in parallel and the finished rows written out.
+class GGridder {
+
+private:
+
+	class cPoint {
+	public:
+		double x, y, v;
+	};
+
+	//Samples sorted into square bins, bin (i,j) holds Points[Start[k]..Start[k+1]), k = j*NX+i
+	class cBins {
+	public:
+		double X0 = 0.0, Y0 = 0.0, Size = 1.0;
+		size_t NX = 0, NY = 0;
+		std::vector<size_t> Start;
+		std::vector<cPoint> Points;
+
+		void build(std::vector<cPoint>& pts, const double x0, const double y0, const double x1, const double y1, const double size) {
+			X0 = x0;
+			Y0 = y0;
+			Size = size;
+			NX = std::max((size_t)1, (size_t)std::ceil((x1 - x0) / size));
+			NY = std::max((size_t)1, (size_t)std::ceil((y1 - y0) / size));
+			Start.assign(NX * NY + 1, 0);
+			std::vector<size_t> bin(pts.size());
+			for (size_t k = 0; k < pts.size(); k++) {
+				bin[k] = index(pts[k].x, pts[k].y);
+				Start[bin[k] + 1]++;
+			}
+			for (size_t k = 0; k < NX * NY; k++) Start[k + 1] += Start[k];
+			std::vector<size_t> next(Start.begin(), Start.end() - 1);
+			Points.resize(pts.size());
+			for (size_t k = 0; k < pts.size(); k++) Points[next[bin[k]]++] = pts[k];
+			std::vector<cPoint>().swap(pts);
+		}
+
+		size_t clampi(const double x) const {
+			const double i = std::floor((x - X0) / Size);
+			return (size_t)std::max(0.0, std::min((double)NX - 1.0, i));
+		}
+
+		size_t clampj(const double y) const {
+			const double j = std::floor((y - Y0) / Size);
+			return (size_t)std::max(0.0, std::min((double)NY - 1.0, j));
+		}
+
+		size_t index(const double x, const double y) const {
+			return clampj(y) * NX + clampi(x);
+		}
+	};
+
+	cGridOptions O;
+	double Radius = 0.0;
+
+	//Valid samples of one line, x/y/value nulls dropped
+	void read_line(GFile& f, const size_t li, std::vector<cPoint>& pts) const {
+		std::vector<double> x, y, v;
+		size_t nb;
+		f.getLineAsDouble(O.xvar, li, x, nb);
+		f.getLineAsDouble(O.yvar, li, y, nb);
+		f.getLineAsDouble(O.var, li, v, nb);
+		if (O.band >= nb) {
+			std::string msg = _SRC_ + strprint("\nVariable (%s) does not have band %zu\n", O.var.c_str(), O.band);
+			throw(std::exception(msg.c_str()));
+		}
+		pts.clear();
+		for (size_t si = 0; si < x.size(); si++) {
+			const cPoint p = { x[si], y[si], v[si * nb + O.band] };
+			if (p.x != p.x || p.y != p.y || p.v != p.v) continue;
+			pts.push_back(p);
+		}
+	}
+
+	float cell(const cBins& B, const double cx, const double cy, std::vector<std::pair<double, double>>& near) const {
+		const double r2 = Radius * Radius;
+		near.clear();
+		const size_t i0 = B.clampi(cx - Radius), i1 = B.clampi(cx + Radius);
+		const size_t j0 = B.clampj(cy - Radius), j1 = B.clampj(cy + Radius);
+		for (size_t j = j0; j <= j1; j++) {
+			for (size_t i = i0; i <= i1; i++) {
+				const size_t k = j * B.NX + i;
+				for (size_t p = B.Start[k]; p < B.Start[k + 1]; p++) {
+					const cPoint& q = B.Points[p];
+					const double d2 = (q.x - cx) * (q.x - cx) + (q.y - cy) * (q.y - cy);
+					if (d2 <= r2) near.push_back(std::make_pair(d2, q.v));
+				}
+			}
+		}
+		if (near.size() == 0) return O.nullvalue;
+
+		if (O.method == eGridMethod::NEAREST) {
+			return (float)std::min_element(near.begin(), near.end())->second;
+		}
+
+		if (O.maxpoints > 0 && near.size() > O.maxpoints) {
+			std::nth_element(near.begin(), near.begin() + O.maxpoints, near.end());
+			near.resize(O.maxpoints);
+		}
+		double sw = 0.0, swv = 0.0;
+		for (const auto& n : near) {
+			if (n.first < 1e-12) return (float)n.second;
+			const double w = (O.power == 2.0) ? 1.0 / n.first : 1.0 / std::pow(n.first, 0.5 * O.power);
+			sw += w;
+			swv += w * n.second;
+		}
+		return (float)(swv / sw);
+	}
+
+	//Grid rows [ja, jb) from the samples within a radius of them
+	void strip(GFile& f, const size_t ja, const size_t jb, cGridWriter& w) const {
+		const double cs = O.cellsize;
+		const double xa = O.x0 - Radius, xb = O.x0 + (double)O.nx * cs + Radius;
+		const double ya = O.y0 + (double)ja * cs - Radius, yb = O.y0 + (double)jb * cs + Radius;
+
+		std::vector<cPoint> pts, line;
+		for (size_t li = 0; li < f.nlines(); li++) {
+			read_line(f, li, line);
+			for (const cPoint& p : line) {
+				if (p.x < xa || p.x > xb || p.y < ya || p.y > yb) continue;
+				pts.push_back(p);
+			}
+		}
+		cBins B;
+		B.build(pts, xa, ya, xb, yb, std::max(Radius, cs));
+
+		const size_t nrows = jb - ja;
+		const size_t tc = std::max((size_t)1, O.tilecells);
+		const size_t ntx = (O.nx + tc - 1) / tc;
+		const size_t nty = (nrows + tc - 1) / tc;
+		std::vector<float> rows(nrows * O.nx);
+		parallel_for(ntx * nty, [&](const size_t t) {
+			GTraceScope trace("grid tile", t);
+			const size_t tx = t % ntx, ty = t / ntx;
+			std::vector<std::pair<double, double>> near;
+			for (size_t j = ty * tc; j < std::min(nrows, (ty + 1) * tc); j++) {
+				const double cy = O.y0 + ((double)(ja + j) + 0.5) * cs;
+				for (size_t i = tx * tc; i < std::min(O.nx, (tx + 1) * tc); i++) {
+					const double cx = O.x0 + ((double)i + 0.5) * cs;
+					rows[j * O.nx + i] = cell(B, cx, cy, near);
+				}
+			}
+		}, O.nthreads);
+		w.put_rows(ja, nrows, rows.data());
+	}
+
+	//Cover the data with whole cells when no grid size was given
+	void extent(GFile& f) {
+		if (O.nx > 0 && O.ny > 0) return;
+		double xmin, xmax, ymin, ymax;
+		f.getSampleVar(O.xvar).minmax(xmin, xmax);
+		f.getSampleVar(O.yvar).minmax(ymin, ymax);
+		if (!(xmax >= xmin) || !(ymax >= ymin)) {
+			std::string msg = _SRC_ + strprint("\nThere are no valid coordinates to grid\n");
+			throw(std::exception(msg.c_str()));
+		}
+		const double cs = O.cellsize;
+		O.x0 = std::floor(xmin / cs) * cs;
+		O.y0 = std::floor(ymin / cs) * cs;
+		O.nx = (size_t)std::floor((xmax - O.x0) / cs) + 1;
+		O.ny = (size_t)std::floor((ymax - O.y0) / cs) + 1;
+	}
+
+	//Split the rows into strips whose samples and rows fit within the memory limit
+	std::vector<size_t> strips(GFile& f) const {
+		const double cs = O.cellsize;
+		const size_t rowbytes = O.nx * sizeof(float);
+		const size_t pointbytes = sizeof(cPoint) * 2 + sizeof(size_t);//points, binned copy and bin index
+		std::vector<size_t> cuts = { 0 };
+		if (f.ntotalsamples() * pointbytes + O.ny * rowbytes <= O.memorylimit) {
+			cuts.push_back(O.ny);
+			return cuts;
+		}
+
+		//Samples per row, including those within a radius beyond the grid
+		const size_t rr = (size_t)std::ceil(Radius / cs);
+		std::vector<size_t> count(O.ny + 2 * rr + 1, 0);
+		std::vector<cPoint> line;
+		for (size_t li = 0; li < f.nlines(); li++) {
+			read_line(f, li, line);
+			for (const cPoint& p : line) {
+				const double j = std::floor((p.y - O.y0) / cs) + (double)rr;
+				if (j < 0.0 || j >= (double)count.size()) continue;
+				count[(size_t)j]++;
+			}
+		}
+		std::vector<size_t> cum(count.size() + 1, 0);
+		for (size_t k = 0; k < count.size(); k++) cum[k + 1] = cum[k] + count[k];
+
+		//Samples needed by rows [ja, jb) lie in count rows [ja, jb + 2rr)
+		size_t ja = 0;
+		while (ja < O.ny) {
+			size_t jb = ja + 1;
+			while (jb < O.ny) {
+				const size_t np = cum[std::min(count.size(), jb + 1 + 2 * rr)] - cum[ja];
+				if (np * pointbytes + (jb + 1 - ja) * rowbytes > O.memorylimit) break;
+				jb++;
+			}
+			cuts.push_back(jb);
+			ja = jb;
+		}
+		return cuts;
+	}
+
+public:
+
+	GGridder(const cGridOptions& options) : O(options) {
+		if (!(O.cellsize > 0.0)) {
+			std::string msg = _SRC_ + strprint("\nGrid cell size must be positive\n");
+			throw(std::exception(msg.c_str()));
+		}
+		Radius = O.radius > 0.0 ? O.radius : 2.0 * O.cellsize;
+	}
+
+	//Grid the variable of a file into a raw or netCDF grid file
+	void grid(GFile& f, const std::string& outpath, const eGridFormat format = eGridFormat::NETCDF) {
+		GIOScope scope(f.getId(), "grid", O.var);
+		extent(f);
+		std::unique_ptr<cGridWriter> w;
+		if (format == eGridFormat::RAW) w.reset(new cRawGridWriter(outpath, O.nx, O.ny, O.x0, O.y0, O.cellsize, O.nullvalue));
+		else w.reset(new cNcGridWriter(outpath, O.var, O.nx, O.ny, O.x0, O.y0, O.cellsize, O.nullvalue));
+		grid(f, *w);
+		w->close();
+	}
+
+	//Grid the variable of a file, handing the rows to a writer
+	void grid(GFile& f, cGridWriter& w) {
+		extent(f);
+		//North strip first, so a raw grid is written front to back
+		const std::vector<size_t> cuts = strips(f);
+		for (size_t k = cuts.size() - 1; k > 0; k--) {
+			strip(f, cuts[k - 1], cuts[k], w);
+		}
+	}
+
+	//Grid geometry, filled in by grid() when it was not given
+	size_t nx() const { return O.nx; }
+	size_t ny() const { return O.ny; }
+	double x0() const { return O.x0; }
+	double y0() const { return O.y0; }
+};
+
+};//endname space
@@ -0,0 +1,167 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <memory>
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+// The variables of one line handed to a map function.
+// Values are double with nulls as NaN, line variables are repeated for every sample.
+class GLineData {
+
+private:
+
+	std::vector<std::string> Names;
+	std::vector<std::vector<double>> Values;
+	std::vector<size_t> NBands;
+
+	size_t find(const std::string& name) const {
+		for (size_t i = 0; i < Names.size(); i++) {
+			if (Names[i] == name) return i;
+		}
+		std::string msg = _SRC_ + strprint("\nVariable (%s) was not requested for the map\n", name.c_str());
+		throw(std::exception(msg.c_str()));
+	}
+
+public:
+
+	size_t lineindex = 0;
+	int linenumber = 0;
+	size_t nsamples = 0;
+
+	GLineData(const std::vector<std::string>& names)
+		: Names(names), Values(names.size()), NBands(names.size(), 1)
+	{}
+
+	//Read the line from a file, called with the netCDF lock held
+	void read(GFile& file, const size_t li, const int number) {
+		lineindex = li;
+		linenumber = number;
+		nsamples = file.nlinesamples(li);
+		for (size_t i = 0; i < Names.size(); i++) {
+			file.getLineAsDouble(Names[i], li, Values[i], NBands[i]);
+		}
+	}
+
+	//nsamples x nbands values of a variable, sample major
+	const std::vector<double>& operator[](const std::string& name) const { return Values[find(name)]; }
+
+	size_t nbands(const std::string& name) const { return NBands[find(name)]; }
+
+	const std::vector<std::string>& names() const { return Names; }
+};
+
+// A read-only handle on the file being mapped, opened and closed under netcdf_mutex()
+class cMapFile {
+
+private:
+
+	std::unique_ptr<GFile> F;
+
+public:
+
+	cMapFile(const std::string& path) {
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		F.reset(new GFile(path, NcFile::read));
+	}
+
+	cMapFile(const cMapFile&) = delete;
+	cMapFile& operator=(const cMapFile&) = delete;
+
+	~cMapFile() {
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		F.reset();
+	}
+
+	GFile& file() { return *F; }
+};
+
+// Runs f(d, t) for every line d of the file on thread t of nthreads threads (0 = all cores).
+// Lines are scheduled weighted by their number of samples with work stealing
+// (see parallel_for_weighted()). All threads read through the one handle, the netCDF
+// library is not thread-safe so the reads are serialised under netcdf_mutex() and only
+// the work f does on the lines runs concurrently. The speedup is bounded by the fraction
+// of the time spent in f rather than in reading.
+template<typename F>
+void for_each_line(GFile& file, const std::vector<std::string>& varnames, F f, const size_t nthreads)
+{
+	std::vector<size_t> weight;
+	std::vector<int> linenumbers;
+	{
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		linenumbers = file.getLineNumbers();
+		weight.resize(file.nlines());
+		for (size_t li = 0; li < file.nlines(); li++) {
+			//A line with no samples still costs a read
+			weight[li] = file.nlinesamples(li) + 1;
+		}
+	}
+
+	parallel_for_weighted(weight, [&](const size_t li, const size_t t) {
+		GLineData d(varnames);
+		{
+			std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+			d.read(file, li, li < linenumbers.size() ? linenumbers[li] : (int)li);
+		}
+		f(d, t);
+	}, nthreads);
+}
+
+// Runs a per-line map function over every line of a file and returns the results in line order.
+// The reads are serialised and the map functions run concurrently, see for_each_line().
+//
+//   map : R(const GLineData&)
+template<typename R, typename Map>
+std::vector<R> map_lines(const std::string& path, const std::vector<std::string>& varnames, Map map, const size_t nthreads = 0)
+{
+	cMapFile mf(path);
+	std::vector<std::unique_ptr<R>> results(mf.file().nlines());
+	for_each_line(mf.file(), varnames, [&](const GLineData& d, const size_t) {
+		results[d.lineindex].reset(new R(map(d)));
+	}, nthreads);
+
+	std::vector<R> out;
+	out.reserve(results.size());
+	for (size_t li = 0; li < results.size(); li++) {
+		out.push_back(std::move(*results[li]));
+	}
+	return out;
+}
+
+// As map_lines() but the per-line results are folded with a reduce function.
+// Each thread folds the results of its own lines as they are mapped and the per-thread
+// results are folded into init at the end, so the per-line results are not kept.
+// Which lines a thread gets depends on the scheduling, so reduce must be associative and
+// commutative, and a floating point sum may differ in the last bits from run to run.
+//
+//   map    : R(const GLineData&)
+//   reduce : R(const R&, const R&)
+template<typename R, typename Map, typename Reduce>
+R map_reduce_lines(const std::string& path, const std::vector<std::string>& varnames, Map map, Reduce reduce, const R& init, const size_t nthreads = 0)
+{
+	const size_t nt = nthreads == 0 ? default_nthreads() : nthreads;
+	std::vector<std::unique_ptr<R>> partial(std::max((size_t)1, nt));
+	{
+		cMapFile mf(path);
+		for_each_line(mf.file(), varnames, [&](const GLineData& d, const size_t t) {
+			if (partial[t]) *partial[t] = reduce(*partial[t], map(d));
+			else partial[t].reset(new R(map(d)));
+		}, nt);
+	}
+
+	R r = init;
+	for (size_t t = 0; t < partial.size(); t++) {
+		if (partial[t]) r = reduce(r, *partial[t]);
+	}
+	return r;
+}
+
+};//endname space
@@ -0,0 +1,296 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "string_utils.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace GeophysicsNetCDF {
+
+inline size_t popcount64(const uint64_t w) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (size_t)__popcnt64(w);
+#elif defined(__GNUC__) || defined(__clang__)
+	return (size_t)__builtin_popcountll(w);
+#else
+	uint64_t v = w - ((w >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (size_t)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+//Index of the lowest set bit, w must be non-zero
+inline size_t lowestbit64(const uint64_t w) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanForward64(&i, w);
+	return (size_t)i;
+#elif defined(__GNUC__) || defined(__clang__)
+	return (size_t)__builtin_ctzll(w);
+#else
+	size_t i = 0;
+	while (((w >> i) & 1) == 0) i++;
+	return i;
+#endif
+}
+
+//Index of the highest set bit, w must be non-zero
+inline size_t highestbit64(const uint64_t w) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanReverse64(&i, w);
+	return (size_t)i;
+#elif defined(__GNUC__) || defined(__clang__)
+	return (size_t)(63 - __builtin_clzll(w));
+#else
+	size_t i = 63;
+	while (((w >> i) & 1) == 0) i--;
+	return i;
+#endif
+}
+
+// Compact validity bitmask, one bit per element, set where the element is valid (non-null).
+// Masks are built 64 elements at a time with branch-free compares that compilers vectorise,
+// and are combined, counted and searched a 64-bit word at a time.
+class GValidityMask {
+
+private:
+	std::vector<uint64_t> Words;
+	size_t N = 0;
+
+	//Clear the unused bits of the last word
+	void trim() {
+		const size_t r = N % 64;
+		if (r && Words.size()) Words.back() &= (~(uint64_t)0) >> (64 - r);
+	}
+
+	//Masks combined with & or | must cover the same elements
+	void check_same_size(const GValidityMask& rhs) const {
+		if (N != rhs.N || Words.size() != rhs.Words.size()) {
+			std::string msg = _SRC_ + strprint("\nAttempt to combine validity masks of different sizes (%zu and %zu)\n", N, rhs.N);
+			throw(std::exception(msg.c_str()));
+		}
+	}
+
+	template<typename T, typename F>
+	void build_with(const T* v, const size_t n, F isvalid) {
+		N = n;
+		Words.assign((n + 63) / 64, 0);
+		const size_t nfull = n / 64;
+		for (size_t w = 0; w < nfull; w++) {
+			const T* p = v + w * 64;
+			uint64_t bits = 0;
+			for (size_t b = 0; b < 64; b++) {
+				bits |= (uint64_t)isvalid(p[b]) << b;
+			}
+			Words[w] = bits;
+		}
+		for (size_t i = nfull * 64; i < n; i++) {
+			if (isvalid(v[i])) Words[i / 64] |= (uint64_t)1 << (i % 64);
+		}
+	}
+
+public:
+
+	static constexpr size_t npos = (size_t)-1;
+
+	GValidityMask() {};
+
+	explicit GValidityMask(const size_t n, const bool valid = false) {
+		N = n;
+		Words.assign((n + 63) / 64, valid ? ~(uint64_t)0 : 0);
+		trim();
+	}
+
+	//Valid where the value differs from the fill value (and, for floating point, is not NaN)
+	template<typename T>
+	GValidityMask(const T* v, const size_t n, const T fill) {
+		build(v, n, fill);
+	}
+
+	template<typename T>
+	void build(const T* v, const size_t n, const T fill) {
+		if constexpr (std::is_floating_point<T>::value) {
+			build_with(v, n, [fill](const T x) { return (x == x) & (x != fill); });
+		}
+		else {
+			build_with(v, n, [fill](const T x) { return x != fill; });
+		}
+	}
+
+	//Valid where the value is not NaN, for data read with fill values mapped to NaN
+	template<typename T>
+	void build_nan(const T* v, const size_t n) {
+		build_with(v, n, [](const T x) { return x == x; });
+	}
+
+	template<typename T>
+	static GValidityMask from_nan(const T* v, const size_t n) {
+		GValidityMask m;
+		m.build_nan(v, n);
+		return m;
+	}
+
+	//Per-sample mask from a per-element mask of nbands elements per sample,
+	//a sample is valid if all (or any) of its bands are valid
+	GValidityMask samples(const size_t nbands, const bool all = true) const {
+		if (nbands <= 1) return *this;
+		const size_t ns = N / nbands;
+		GValidityMask m(ns);
+		for (size_t si = 0; si < ns; si++) {
+			size_t nvalid = 0;
+			for (size_t bi = 0; bi < nbands; bi++) nvalid += test(si * nbands + bi);
+			if (all ? nvalid == nbands : nvalid > 0) m.set(si, true);
+		}
+		return m;
+	}
+
+	size_t size() const { return N; }
+
+	const std::vector<uint64_t>& words() const { return Words; }
+
+	bool test(const size_t i) const {
+		return (Words[i / 64] >> (i % 64)) & 1;
+	}
+
+	void set(const size_t i, const bool valid) {
+		const uint64_t bit = (uint64_t)1 << (i % 64);
+		if (valid) Words[i / 64] |= bit;
+		else Words[i / 64] &= ~bit;
+	}
+
+	GValidityMask& operator&=(const GValidityMask& rhs) {
+		check_same_size(rhs);
+		for (size_t w = 0; w < Words.size(); w++) Words[w] &= rhs.Words[w];
+		return *this;
+	}
+
+	GValidityMask& operator|=(const GValidityMask& rhs) {
+		check_same_size(rhs);
+		for (size_t w = 0; w < Words.size(); w++) Words[w] |= rhs.Words[w];
+		return *this;
+	}
+
+	GValidityMask operator&(const GValidityMask& rhs) const {
+		GValidityMask m(*this);
+		m &= rhs;
+		return m;
+	}
+
+	GValidityMask operator|(const GValidityMask& rhs) const {
+		GValidityMask m(*this);
+		m |= rhs;
+		return m;
+	}
+
+	GValidityMask operator~() const {
+		GValidityMask m(*this);
+		for (size_t w = 0; w < m.Words.size(); w++) m.Words[w] = ~m.Words[w];
+		m.trim();
+		return m;
+	}
+
+	//Concatenate another mask onto the end of this one
+	void append(const GValidityMask& m) {
+		const size_t off = N;
+		N += m.N;
+		Words.resize((N + 63) / 64, 0);
+		const size_t w0 = off / 64;
+		const size_t shift = off % 64;
+		for (size_t w = 0; w < m.Words.size(); w++) {
+			Words[w0 + w] |= m.Words[w] << shift;
+			if (shift && w0 + w + 1 < Words.size()) Words[w0 + w + 1] |= m.Words[w] >> (64 - shift);
+		}
+	}
+
+	//Number of valid elements
+	size_t count() const {
+		size_t n = 0;
+		for (size_t w = 0; w < Words.size(); w++) n += popcount64(Words[w]);
+		return n;
+	}
+
+	//Number of null elements
+	size_t nnull() const { return N - count(); }
+
+	bool any() const {
+		for (size_t w = 0; w < Words.size(); w++) {
+			if (Words[w]) return true;
+		}
+		return false;
+	}
+
+	bool all() const { return count() == N; }
+
+	//Index of the first valid element, or npos
+	size_t first() const {
+		for (size_t w = 0; w < Words.size(); w++) {
+			if (Words[w]) return w * 64 + lowestbit64(Words[w]);
+		}
+		return npos;
+	}
+
+	//Index of the last valid element, or npos
+	size_t last() const {
+		for (size_t w = Words.size(); w-- > 0; ) {
+			if (Words[w]) return w * 64 + highestbit64(Words[w]);
+		}
+		return npos;
+	}
+
+	//Index of the first valid element at or after i, or npos
+	size_t next(const size_t i) const {
+		if (i >= N) return npos;
+		size_t w = i / 64;
+		uint64_t word = Words[w] & ((~(uint64_t)0) << (i % 64));
+		for (;;) {
+			if (word) return w * 64 + lowestbit64(word);
+			if (++w >= Words.size()) return npos;
+			word = Words[w];
+		}
+	}
+
+	//Index of the first null element at or after i, or size() if there is none
+	size_t next_null(const size_t i) const {
+		if (i >= N) return N;
+		size_t w = i / 64;
+		uint64_t word = ~Words[w] & ((~(uint64_t)0) << (i % 64));
+		for (;;) {
+			if (word) return std::min(N, w * 64 + lowestbit64(word));
+			if (++w >= Words.size()) return N;
+			word = ~Words[w];
+		}
+	}
+
+	//Runs of consecutive valid elements as (first, count) pairs
+	std::vector<std::pair<size_t, size_t>> runs() const {
+		std::vector<std::pair<size_t, size_t>> r;
+		for (size_t i = next(0); i != npos; ) {
+			const size_t e = next_null(i);
+			r.push_back(std::make_pair(i, e - i));
+			i = next(e);
+		}
+		return r;
+	}
+
+};
+
+};//endname space
@@ -0,0 +1,254 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <list>
+#include <set>
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+// Read-only view of many GFiles as a single dataset.
+// Lines from all files are presented with one global zero-based line index,
+// in the order the files are given. Variables are addressed by a unified
+// name which matches either the variable name or its long_name in each file.
+// At most maxopenfiles files are held open at once, the least recently used
+// handles are closed when the limit is reached.
+class GMosaic {
+
+private:
+
+	class cMember {
+	public:
+		std::string path;
+		size_t firstline = 0;//global index of the file's first line
+		size_t firstsample = 0;//global index of the file's first sample
+		size_t nlines = 0;
+		std::map<std::string, std::string> names;//unified name -> variable name in the file
+	};
+
+	std::vector<cMember> Members;
+	std::vector<size_t> LineFile;//file index of each global line
+	std::vector<unsigned int> LineNumber;
+	std::vector<unsigned int> LineCount;
+	std::vector<size_t> LineStart;//global index of the first sample of each line
+	std::vector<std::string> VarNames;
+
+	size_t MaxOpenFiles;
+	mutable std::mutex PoolMutex;
+	mutable std::list<size_t> Recent;//most recently used first
+	mutable std::map<size_t, std::shared_ptr<GFile>> Pool;
+
+	void scan(const size_t fi, GFile& f) {
+		cMember& m = Members[fi];
+		m.nlines = f.nlines();
+		std::vector<int> ln = f.getLineNumbers();
+		for (size_t li = 0; li < m.nlines; li++) {
+			LineFile.push_back(fi);
+			LineNumber.push_back(li < ln.size() ? (unsigned int)ln[li] : (unsigned int)li);
+			LineCount.push_back((unsigned int)f.get_line_index_count(li));
+		}
+
+		std::set<std::string> unique(VarNames.begin(), VarNames.end());
+		std::vector<NcVar> vars = f.getAllVars();
+		for (const NcVar& v : vars) {
+			const std::string name = v.getName();
+			m.names[name] = name;
+			if (unique.insert(name).second) VarNames.push_back(name);
+		}
+		//long_name matches only where they do not clash with a variable name
+		for (const NcVar& v : vars) {
+			GVar gv(f, v);
+			const std::string lname = gv.getStringAtt(AN_LONG_NAME);
+			if (lname.size() == 0) continue;
+			if (m.names.find(lname) != m.names.end()) continue;
+			m.names[lname] = v.getName();
+		}
+	}
+
+	//Take the least recently used handles beyond the limit out of the pool, called with PoolMutex held.
+	//Handles still referenced by a caller are kept. The caller closes the returned handles (see close())
+	//after releasing PoolMutex, so that lock is never held while waiting for netcdf_mutex().
+	std::vector<std::shared_ptr<GFile>> release_unused() const {
+		std::vector<std::shared_ptr<GFile>> released;
+		while (Pool.size() > MaxOpenFiles) {
+			auto it = std::find_if(Recent.rbegin(), Recent.rend(),
+				[this](const size_t fi) { return Pool[fi].use_count() == 1; });
+			if (it == Recent.rend()) break;
+			const size_t fi = *it;
+			Recent.erase(std::next(it).base());
+			released.push_back(std::move(Pool[fi]));
+			Pool.erase(fi);
+		}
+		return released;
+	}
+
+	static void close(std::vector<std::shared_ptr<GFile>>& handles) {
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		handles.clear();
+	}
+
+public:
+
+	GMosaic(const std::vector<std::string>& paths, const size_t maxopenfiles = 64)
+	{
+		MaxOpenFiles = std::max((size_t)1, maxopenfiles);
+		Members.resize(paths.size());
+		for (size_t fi = 0; fi < paths.size(); fi++) {
+			Members[fi].path = paths[fi];
+			Members[fi].firstline = LineFile.size();
+			Members[fi].firstsample = LineStart.size() ? LineStart.back() + LineCount.back() : 0;
+			std::shared_ptr<GFile> f = file(fi);
+			scan(fi, *f);
+			for (size_t li = 0; li < Members[fi].nlines; li++) {
+				const size_t gli = Members[fi].firstline + li;
+				LineStart.push_back(gli == 0 ? 0 : LineStart[gli - 1] + LineCount[gli - 1]);
+			}
+		}
+	}
+
+	~GMosaic() {
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		Pool.clear();
+	}
+
+	//Do not allow copying, the handle pool is not shareable
+	GMosaic(const GMosaic& rhs) = delete;
+	GMosaic& operator=(const GMosaic& rhs) = delete;
+
+	size_t nfiles() const { return Members.size(); }
+	size_t nlines() const { return LineFile.size(); }
+	size_t ntotalsamples() const { return LineStart.size() ? LineStart.back() + LineCount.back() : 0; }
+	size_t nlinesamples(const size_t lineindex) const { return LineCount[lineindex]; }
+	size_t get_line_index_start(const size_t lineindex) const { return LineStart[lineindex]; }
+	size_t get_line_index_count(const size_t lineindex) const { return LineCount[lineindex]; }
+	const std::vector<unsigned int>& getLineNumbers() const { return LineNumber; }
+	const std::vector<std::string>& getVarNames() const { return VarNames; }
+	const std::string& filepath(const size_t fileindex) const { return Members[fileindex].path; }
+
+	//Index of the file holding a global line
+	size_t fileindex(const size_t lineindex) const { return LineFile[lineindex]; }
+
+	//Index of a global line within the file that holds it
+	size_t localindex(const size_t lineindex) const { return lineindex - Members[LineFile[lineindex]].firstline; }
+
+	//Name of the variable matching a unified name in a file, empty if the file does not have it
+	std::string localname(const size_t fileindex, const std::string& name) const {
+		const auto& m = Members[fileindex].names;
+		auto it = m.find(name);
+		if (it == m.end()) return std::string();
+		return it->second;
+	}
+
+	bool hasVar(const size_t fileindex, const std::string& name) const {
+		return localname(fileindex, name).size() > 0;
+	}
+
+	//True if every file in the mosaic has the variable
+	bool hasVar(const std::string& name) const {
+		for (size_t fi = 0; fi < nfiles(); fi++) {
+			if (hasVar(fi, name) == false) return false;
+		}
+		return nfiles() > 0;
+	}
+
+	size_t getLineIndex(const unsigned int linenumber) const {
+		auto it = std::find(LineNumber.begin(), LineNumber.end(), linenumber);
+		return (size_t)(it - LineNumber.begin());
+	}
+
+	//Shared handle to an open file, opening it and closing unused handles as needed.
+	//Files are opened and closed outside PoolMutex, so this may be called with netcdf_mutex() held.
+	std::shared_ptr<GFile> file(const size_t fileindex) const {
+		{
+			std::lock_guard<std::mutex> lock(PoolMutex);
+			auto it = Pool.find(fileindex);
+			if (it != Pool.end()) {
+				Recent.remove(fileindex);
+				Recent.push_front(fileindex);
+				return it->second;
+			}
+		}
+
+		std::shared_ptr<GFile> f;
+		{
+			std::lock_guard<std::recursive_mutex> nclock(netcdf_mutex());
+			f = std::make_shared<GFile>(Members[fileindex].path, NcFile::read);
+		}
+
+		std::vector<std::shared_ptr<GFile>> released;
+		{
+			std::lock_guard<std::mutex> lock(PoolMutex);
+			auto it = Pool.find(fileindex);
+			if (it != Pool.end()) {
+				//Another thread opened it meanwhile, use theirs and close ours
+				released.push_back(std::move(f));
+				f = it->second;
+				Recent.remove(fileindex);
+			}
+			else {
+				Pool[fileindex] = f;
+			}
+			Recent.push_front(fileindex);
+			std::vector<std::shared_ptr<GFile>> unused = release_unused();
+			for (auto& h : unused) released.push_back(std::move(h));
+		}
+		close(released);
+		return f;
+	}
+
+	size_t nopenfiles() const {
+		std::lock_guard<std::mutex> lock(PoolMutex);
+		return Pool.size();
+	}
+
+	template<typename T>
+	bool getDataByLineIndex(const std::string& name, const size_t& lineindex, std::vector<T>& vals) const {
+		if (lineindex >= nlines()) return false;
+		const size_t fi = fileindex(lineindex);
+		const std::string vname = localname(fi, name);
+		if (vname.size() == 0) return false;
+
+		std::shared_ptr<GFile> f = file(fi);
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		GVar v = f->getGeophysicsVar(vname);
+		if (v.isLineVar()) {
+			return v.getRecord(localindex(lineindex), vals);
+		}
+		else if (v.isSampleVar()) {
+			GSampleVar sv(*f, v);
+			return sv.getLine(localindex(lineindex), vals);
+		}
+		return false;
+	}
+
+	template<typename T>
+	bool getDataByLineIndex(const std::string& name, const size_t& lineindex, andres::Marray<T>& A) const {
+		if (lineindex >= nlines()) return false;
+		const size_t fi = fileindex(lineindex);
+		const std::string vname = localname(fi, name);
+		if (vname.size() == 0) return false;
+
+		std::shared_ptr<GFile> f = file(fi);
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		GVar v = f->getGeophysicsVar(vname);
+		v.getLine(localindex(lineindex), A);
+		return true;
+	}
+
+	template<typename T>
+	bool getDataByLineNumber(const std::string& name, const unsigned int& linenumber, std::vector<T>& vals) const {
+		size_t index = getLineIndex(linenumber);
+		if (index >= nlines()) return false;
+		return getDataByLineIndex(name, index, vals);
+	}
+
+};
+
+};//endname space
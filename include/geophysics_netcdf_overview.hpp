@@ -0,0 +1,374 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+constexpr auto GN_OVERVIEWS = "overviews";
+constexpr auto AN_BUCKET_SAMPLES = "bucket_samples";
+constexpr auto AN_SAMPLE_SPACING = "sample_spacing";
+constexpr auto AN_XVAR = "x_variable";
+constexpr auto AN_YVAR = "y_variable";
+
+class cOverviewOptions {
+public:
+	std::vector<std::string> varnames;//single band sample variables to summarise
+	std::string xvar = "easting";
+	std::string yvar = "northing";
+	size_t factor = 8;//level k has buckets of factor^k samples
+	size_t nlevels = 0;//0 builds levels until every line fits in one bucket
+};
+
+// Overview levels are stored in the groups overviews/level_1, overviews/level_2, ...
+// Each line of the file is split into buckets of bucket_samples consecutive samples and
+// each bucket becomes one sample of the level, holding the mean of the x and y coordinates
+// and the <var>_min, <var>_max and <var>_mean of each chosen variable, nulls ignored.
+// A level has its own line index (line_index_start/line_index_count), its own line numbers
+// and the extent of each line, so a viewer reads only the lines it shows at the coarsest
+// level that still resolves a screen pixel (see best_overview_level()).
+class GOverview {
+
+private:
+
+	GFile& File;
+	NcGroup Group;
+	size_t Level = 0;
+	size_t BucketSamples = 1;
+	double Spacing = 0.0;
+	std::string XVar;
+	std::string YVar;
+	std::vector<unsigned int> Start;
+	std::vector<unsigned int> Count;
+
+	static std::string string_att(const NcGroup& g, const std::string& name) {
+		std::string s;
+		g.getAtt(name).getValues(s);
+		return s;
+	}
+
+	void read_line_vars(const std::string& name, std::vector<double>& vals) const {
+		GVar v(File, Group.getVar(name));
+		vals.resize(Start.size());
+		if (vals.size() == 0) return;
+		v.getVarMapped({ (size_t)0 }, { vals.size() }, vals.data(), std::numeric_limits<double>::quiet_NaN());
+	}
+
+public:
+
+	static std::string group_name(const size_t level) {
+		return strprint("level_%zu", level);
+	}
+
+	//Name of the variable holding a bucket statistic ("min", "max" or "mean") of a variable
+	static std::string stat_name(const std::string& varname, const std::string& stat) {
+		return varname + "_" + stat;
+	}
+
+	GOverview(GFile& file, const size_t level) : File(file), Level(level) {
+		NcGroup og = File.getGroup(GN_OVERVIEWS);
+		if (og.isNull() == false) Group = og.getGroup(group_name(level));
+		if (Group.isNull()) {
+			std::string msg = _SRC_ + strprint("\nFile does not have overview level %zu\n", level);
+			throw(std::exception(msg.c_str()));
+		}
+		unsigned int b;
+		Group.getAtt(AN_BUCKET_SAMPLES).getValues(&b);
+		BucketSamples = b;
+		Group.getAtt(AN_SAMPLE_SPACING).getValues(&Spacing);
+		XVar = string_att(Group, AN_XVAR);
+		YVar = string_att(Group, AN_YVAR);
+
+		const size_t nl = Group.getDim(DN_LINE).getSize();
+		Start.resize(nl);
+		Count.resize(nl);
+		if (nl > 0) {
+			Group.getVar(VN_LI_START).getVar(Start.data());
+			Group.getVar(VN_LI_COUNT).getVar(Count.data());
+		}
+	}
+
+	size_t level() const { return Level; }
+	size_t bucketsamples() const { return BucketSamples; }
+	double spacing() const { return Spacing; }//approximate along-line distance between buckets
+	size_t nlines() const { return Start.size(); }
+	size_t nlinesamples(const size_t lineindex) const { return Count[lineindex]; }
+	size_t ntotalsamples() const { return Start.size() ? (size_t)Start.back() + Count.back() : 0; }
+	const std::string& xvar() const { return XVar; }
+	const std::string& yvar() const { return YVar; }
+
+	//Indices of the lines whose extent overlaps the rectangle
+	std::vector<size_t> lines_in_extent(const double x0, const double y0, const double x1, const double y1) const {
+		std::vector<double> xmin, xmax, ymin, ymax;
+		read_line_vars(GFile::summary_name(XVar, false), xmin);
+		read_line_vars(GFile::summary_name(XVar, true), xmax);
+		read_line_vars(GFile::summary_name(YVar, false), ymin);
+		read_line_vars(GFile::summary_name(YVar, true), ymax);
+		std::vector<size_t> lines;
+		for (size_t li = 0; li < nlines(); li++) {
+			if (xmax[li] < x0 || xmin[li] > x1) continue;
+			if (ymax[li] < y0 || ymin[li] > y1) continue;
+			if (xmin[li] != xmin[li]) continue;//no valid coordinates
+			lines.push_back(li);
+		}
+		return lines;
+	}
+
+	//One line of a level variable, the x or y variable or a stat_name(), nulls as NaN
+	void getLine(const std::string& name, const size_t lineindex, std::vector<double>& vals) const {
+		GVar v(File, Group.getVar(name));
+		if (v.isNull()) {
+			std::string msg = _SRC_ + strprint("\nOverview level %zu does not have variable (%s)\n", Level, name.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		vals.resize(Count[lineindex]);
+		if (vals.size() == 0) return;
+		GIOScope scope(v, "overview getLine");
+		scope.count(vals.size());
+		v.getVarMapped({ (size_t)Start[lineindex] }, { vals.size() }, vals.data(), std::numeric_limits<double>::quiet_NaN());
+	}
+};
+
+//Number of overview levels stored in a file
+inline size_t noverviews(GFile& file) {
+	NcGroup og = file.getGroup(GN_OVERVIEWS);
+	if (og.isNull()) return 0;
+	size_t n = 0;
+	while (og.getGroup(GOverview::group_name(n + 1)).isNull() == false) n++;
+	return n;
+}
+
+//Coarsest overview level whose bucket spacing still resolves one pixel when the
+//extent [x0,x1] x [y0,y1] is shown across npixels, 0 if the full resolution data is needed
+inline size_t best_overview_level(GFile& file, const double x0, const double y0, const double x1, const double y1, const size_t npixels) {
+	const double pixel = std::max(std::fabs(x1 - x0), std::fabs(y1 - y0)) / (double)std::max((size_t)1, npixels);
+	size_t best = 0;
+	const size_t n = noverviews(file);
+	for (size_t k = 1; k <= n; k++) {
+		if (GOverview(file, k).spacing() <= pixel) best = k;
+	}
+	return best;
+}
+
+// Builds the overview levels of a file opened for writing that does not already have them.
+// Every line is read once and all levels are made from the full resolution samples.
+class GOverviewBuilder {
+
+private:
+
+	class cLevel {
+	public:
+		size_t bucket = 1;
+		NcGroup group;
+		std::vector<size_t> start;//first bucket of each line
+		std::vector<size_t> count;
+	};
+
+	GFile& File;
+	cOverviewOptions O;
+	std::vector<cLevel> Levels;
+	double Distance = 0.0;//summed distance between consecutive valid coordinates
+	size_t NSteps = 0;
+
+	static size_t nbuckets(const size_t nsamples, const size_t bucket) {
+		return (nsamples + bucket - 1) / bucket;
+	}
+
+	NcVar add_var(cLevel& L, const std::string& name, const NcType& type, const NcDim& dim) {
+		NcVar v = L.group.addVar(name, type, std::vector<NcDim>{ dim });
+		GVar(File, v).set_default_missingvalue();
+		return v;
+	}
+
+	void define() {
+		size_t maxcount = 0;
+		for (size_t li = 0; li < File.nlines(); li++) maxcount = std::max(maxcount, File.nlinesamples(li));
+
+		NcGroup og = File.getGroup(GN_OVERVIEWS);
+		if (og.isNull() == false) {
+			std::string msg = _SRC_ + strprint("\nFile already has overviews\n");
+			throw(std::exception(msg.c_str()));
+		}
+		og = File.addGroup(GN_OVERVIEWS);
+
+		size_t bucket = 1;
+		for (size_t k = 1; O.nlevels == 0 || k <= O.nlevels; k++) {
+			if (O.nlevels == 0 && bucket >= maxcount) break;
+			bucket *= O.factor;
+
+			cLevel L;
+			L.bucket = bucket;
+			L.group = og.addGroup(GOverview::group_name(k));
+			size_t n = 0;
+			for (size_t li = 0; li < File.nlines(); li++) {
+				L.start.push_back(n);
+				L.count.push_back(nbuckets(File.nlinesamples(li), bucket));
+				n += L.count.back();
+			}
+			L.group.putAtt(AN_BUCKET_SAMPLES, ncUint, (unsigned int)bucket);
+			L.group.putAtt(AN_XVAR, O.xvar);
+			L.group.putAtt(AN_YVAR, O.yvar);
+
+			NcDim dp = L.group.addDim(DN_POINT, n);
+			NcDim dl = L.group.addDim(DN_LINE, File.nlines());
+			L.group.addVar(VN_LI_START, ncUint, std::vector<NcDim>{ dl });
+			L.group.addVar(VN_LI_COUNT, ncUint, std::vector<NcDim>{ dl });
+			L.group.addVar(DN_LINE, ncInt, std::vector<NcDim>{ dl });
+			for (const std::string& name : { O.xvar, O.yvar }) {
+				add_var(L, name, ncDouble, dp);
+				add_var(L, GFile::summary_name(name, false), ncDouble, dl);
+				add_var(L, GFile::summary_name(name, true), ncDouble, dl);
+			}
+			for (const std::string& name : O.varnames) {
+				for (const std::string stat : { "min", "max", "mean" }) {
+					add_var(L, GOverview::stat_name(name, stat), ncFloat, dp);
+				}
+			}
+
+			std::vector<unsigned int> ustart(L.start.begin(), L.start.end());
+			std::vector<unsigned int> ucount(L.count.begin(), L.count.end());
+			std::vector<int> numbers = File.getLineNumbers();
+			if (ustart.size()) {
+				L.group.getVar(VN_LI_START).putVar(ustart.data());
+				L.group.getVar(VN_LI_COUNT).putVar(ucount.data());
+				L.group.getVar(DN_LINE).putVar(numbers.data());
+			}
+			Levels.push_back(L);
+		}
+	}
+
+	//Write the buckets of one line of one variable to a level, nulls as the fill value
+	template<typename T>
+	void put(const cLevel& L, const std::string& name, const size_t li, const std::vector<double>& vals) {
+		if (vals.size() == 0) return;
+		GVar v(File, L.group.getVar(name));
+		const T fill = v.missingvalue(T());
+		std::vector<T> buf(vals.size());
+		for (size_t i = 0; i < vals.size(); i++) buf[i] = (vals[i] != vals[i]) ? fill : (T)vals[i];
+		v.putVar({ L.start[li] }, { buf.size() }, buf.data());
+	}
+
+	static void put_line_value(const cLevel& L, const std::string& name, const size_t li, const double value) {
+		const double d = (value != value) ? (double)NC_FILL_DOUBLE : value;
+		L.group.getVar(name).putVar({ li }, { (size_t)1 }, &d);
+	}
+
+	void write_line(const size_t li) {
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		const size_t ns = File.nlinesamples(li);
+		std::vector<double> x, y, v;
+		size_t nb;
+		File.getLineAsDouble(O.xvar, li, x, nb);
+		File.getLineAsDouble(O.yvar, li, y, nb);
+
+		for (size_t si = 1; si < ns; si++) {
+			const double d = std::hypot(x[si] - x[si - 1], y[si] - y[si - 1]);
+			if (d != d) continue;
+			Distance += d;
+			NSteps++;
+		}
+
+		//Extent of the line, the same at every level
+		double xmin = nan, xmax = nan, ymin = nan, ymax = nan;
+		for (size_t si = 0; si < ns; si++) {
+			if (x[si] != x[si] || y[si] != y[si]) continue;
+			if (!(x[si] >= xmin)) xmin = x[si];
+			if (!(x[si] <= xmax)) xmax = x[si];
+			if (!(y[si] >= ymin)) ymin = y[si];
+			if (!(y[si] <= ymax)) ymax = y[si];
+		}
+
+		for (const cLevel& L : Levels) {
+			const size_t n = L.count[li];
+			std::vector<double> bx(n, nan), by(n, nan);
+			for (size_t b = 0; b < n; b++) {
+				double sx = 0.0, sy = 0.0;
+				size_t k = 0;
+				for (size_t si = b * L.bucket; si < std::min(ns, (b + 1) * L.bucket); si++) {
+					if (x[si] != x[si] || y[si] != y[si]) continue;
+					sx += x[si];
+					sy += y[si];
+					k++;
+				}
+				if (k) {
+					bx[b] = sx / (double)k;
+					by[b] = sy / (double)k;
+				}
+			}
+			put<double>(L, O.xvar, li, bx);
+			put<double>(L, O.yvar, li, by);
+			put_line_value(L, GFile::summary_name(O.xvar, false), li, xmin);
+			put_line_value(L, GFile::summary_name(O.xvar, true), li, xmax);
+			put_line_value(L, GFile::summary_name(O.yvar, false), li, ymin);
+			put_line_value(L, GFile::summary_name(O.yvar, true), li, ymax);
+		}
+
+		for (const std::string& name : O.varnames) {
+			File.getLineAsDouble(name, li, v, nb);
+			if (nb != 1) {
+				std::string msg = _SRC_ + strprint("\nOverviews can only be made of single band variables (%s)\n", name.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+			for (const cLevel& L : Levels) {
+				const size_t n = L.count[li];
+				std::vector<double> vmin(n, nan), vmax(n, nan), vmean(n, nan);
+				for (size_t b = 0; b < n; b++) {
+					double s = 0.0;
+					size_t k = 0;
+					for (size_t si = b * L.bucket; si < std::min(ns, (b + 1) * L.bucket); si++) {
+						const double d = v[si];
+						if (d != d) continue;
+						if (!(d >= vmin[b])) vmin[b] = d;
+						if (!(d <= vmax[b])) vmax[b] = d;
+						s += d;
+						k++;
+					}
+					if (k) vmean[b] = s / (double)k;
+				}
+				put<float>(L, GOverview::stat_name(name, "min"), li, vmin);
+				put<float>(L, GOverview::stat_name(name, "max"), li, vmax);
+				put<float>(L, GOverview::stat_name(name, "mean"), li, vmean);
+			}
+		}
+	}
+
+public:
+
+	GOverviewBuilder(GFile& file, const cOverviewOptions& options) : File(file), O(options) {
+		if (O.factor < 2) {
+			std::string msg = _SRC_ + strprint("\nOverview factor must be at least 2\n");
+			throw(std::exception(msg.c_str()));
+		}
+	}
+
+	//Build the levels, returns the number made
+	size_t build() {
+		GIOScope scope(File.getId(), "add_overviews");
+		define();
+		for (size_t li = 0; li < File.nlines(); li++) {
+			GTraceScope trace("overview line", li);
+			write_line(li);
+		}
+
+		//Known only once every line has been read
+		const double spacing = NSteps ? Distance / (double)NSteps : 0.0;
+		for (const cLevel& L : Levels) {
+			L.group.putAtt(AN_SAMPLE_SPACING, ncDouble, spacing * (double)L.bucket);
+		}
+		return Levels.size();
+	}
+};
+
+//Build the overview levels of a file opened for writing, returns the number of levels
+inline size_t add_overviews(GFile& file, const cOverviewOptions& options) {
+	return GOverviewBuilder(file, options).build();
+}
+
+};//endname space
@@ -0,0 +1,175 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GeophysicsNetCDF {
+
+// The netCDF-C library is not thread-safe, so every call into it made from
+// a worker thread must hold this lock. Only the I/O is serialised, the
+// processing of the data read or written runs concurrently.
+inline std::recursive_mutex& netcdf_mutex() {
+	static std::recursive_mutex m;
+	return m;
+}
+
+// Nesting depth of instrumented calls (see GIOScope) on this thread. Worker threads
+// start at the depth of the thread that launched them, so I/O done on the workers
+// of an instrumented call is counted once, by that call.
+inline int& io_scope_depth() {
+	thread_local int d = 0;
+	return d;
+}
+
+inline size_t default_nthreads() {
+	const size_t n = (size_t)std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+// Calls f(i) for every i in [0,n) using nthreads threads (0 = all cores).
+// Indices are handed out one at a time so uneven work balances itself.
+// The first exception thrown by any f(i) is rethrown on the calling thread.
+template<typename F>
+void parallel_for(const size_t n, F f, size_t nthreads = 0)
+{
+	if (nthreads == 0) nthreads = default_nthreads();
+	nthreads = std::min(nthreads, n);
+	if (nthreads <= 1) {
+		for (size_t i = 0; i < n; i++) f(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr eptr;
+	std::mutex emutex;
+	const int depth = io_scope_depth();
+	auto worker = [&]() {
+		io_scope_depth() = depth;
+		try {
+			for (size_t i = next++; i < n; i = next++) f(i);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(emutex);
+			if (!eptr) eptr = std::current_exception();
+			next = n;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t ti = 1; ti < nthreads; ti++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads) t.join();
+	if (eptr) std::rethrow_exception(eptr);
+}
+
+// Calls f(i, threadindex) for every i in [0,n) using nthreads threads (0 = all cores),
+// where weight[i] is the expected cost of item i (e.g. the number of samples in a line).
+// Items are dealt heaviest first to the least loaded thread, each thread works through
+// its own queue heaviest first and, when that is empty, steals the lightest remaining
+// items from the back of the most loaded other queue.
+// The first exception thrown by any f is rethrown on the calling thread.
+template<typename F>
+void parallel_for_weighted(const std::vector<size_t>& weight, F f, size_t nthreads = 0)
+{
+	const size_t n = weight.size();
+	if (nthreads == 0) nthreads = default_nthreads();
+	nthreads = std::min(nthreads, n);
+	if (nthreads <= 1) {
+		for (size_t i = 0; i < n; i++) f(i, (size_t)0);
+		return;
+	}
+
+	std::vector<size_t> order(n);
+	for (size_t i = 0; i < n; i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&weight](const size_t a, const size_t b) { return weight[a] > weight[b]; });
+
+	struct cQueue {
+		std::mutex mutex;
+		std::deque<size_t> items;
+		size_t load = 0;//total weight of the items still queued
+	};
+	std::vector<cQueue> queues(nthreads);
+	for (const size_t i : order) {
+		size_t q = 0;
+		for (size_t t = 1; t < nthreads; t++) {
+			if (queues[t].load < queues[q].load) q = t;
+		}
+		queues[q].items.push_back(i);
+		queues[q].load += weight[i];
+	}
+
+	std::atomic<bool> stop(false);
+	std::exception_ptr eptr;
+	std::mutex emutex;
+
+	auto take = [&](const size_t t, size_t& item) {
+		{
+			std::lock_guard<std::mutex> lock(queues[t].mutex);
+			if (queues[t].items.size()) {
+				item = queues[t].items.front();
+				queues[t].items.pop_front();
+				queues[t].load -= weight[item];
+				return true;
+			}
+		}
+		for (;;) {
+			size_t victim = t;
+			size_t maxload = 0;
+			for (size_t v = 0; v < nthreads; v++) {
+				if (v == t) continue;
+				std::lock_guard<std::mutex> lock(queues[v].mutex);
+				if (queues[v].items.size() && (victim == t || queues[v].load > maxload)) {
+					victim = v;
+					maxload = queues[v].load;
+				}
+			}
+			if (victim == t) return false;
+			std::lock_guard<std::mutex> lock(queues[victim].mutex);
+			if (queues[victim].items.size() == 0) continue;//emptied meanwhile, look again
+			item = queues[victim].items.back();
+			queues[victim].items.pop_back();
+			queues[victim].load -= weight[item];
+			return true;
+		}
+	};
+
+	const int depth = io_scope_depth();
+	auto worker = [&](const size_t t) {
+		io_scope_depth() = depth;
+		try {
+			size_t item;
+			while (stop == false && take(t, item)) f(item, t);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(emutex);
+			if (!eptr) eptr = std::current_exception();
+			stop = true;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < nthreads; t++) {
+		threads.emplace_back(worker, t);
+	}
+	worker(0);
+	for (auto& th : threads) th.join();
+	if (eptr) std::rethrow_exception(eptr);
+}
+
+};//endname space
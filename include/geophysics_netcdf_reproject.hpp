@@ -0,0 +1,211 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include "geophysics_netcdf.hpp"
+
+#ifdef ENABLE_GDAL
+
+namespace GeophysicsNetCDF {
+
+class cReprojectOptions {
+public:
+	std::string xvar = "easting";//input coordinates
+	std::string yvar = "northing";
+	int srcepsg = 0;//0 to use the spatial_ref of the file's crs variable
+	int dstepsg = 0;
+	std::string dstxvar;//output coordinates, empty for longitude/latitude or easting_<epsg>/northing_<epsg>
+	std::string dstyvar;
+	std::string crsvar;//variable describing the output crs, empty for crs if there is none yet otherwise crs_<epsg>
+	size_t nthreads = 0;//0 for all cores
+};
+
+// Reprojects a pair of coordinate variables into new variables in the same (writable) file.
+// Lines are read one at a time through the file's handle and each is transformed in a single
+// call, in parallel, with one transformation object per thread since they are not thread safe.
+// Nulls, and points that fail to transform, are null in the output.
+// The geospatial_* global attributes are refreshed from the new coordinates.
+class GReprojector {
+
+private:
+
+	cReprojectOptions O;
+	OGRSpatialReference Src;
+	OGRSpatialReference Dst;
+
+	//x,y are easting,northing or longitude,latitude whatever the authority says
+	static void traditional_order(OGRSpatialReference& srs) {
+#if GDAL_VERSION_MAJOR >= 3
+		srs.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#endif
+	}
+
+	class cTransform {
+	public:
+		OGRCoordinateTransformation* ct = nullptr;
+		cTransform() {}
+		cTransform(const cTransform&) = delete;
+		cTransform& operator=(const cTransform&) = delete;
+		~cTransform() {
+			if (ct) OCTDestroyCoordinateTransformation((OGRCoordinateTransformationH)ct);
+		}
+	};
+
+	static void import_epsg(OGRSpatialReference& srs, const int epsgcode) {
+		if (srs.importFromEPSG(epsgcode) != OGRERR_NONE) {
+			std::string msg = _SRC_ + strprint("\nUnknown or unsupported EPSG code %d\n", epsgcode);
+			throw(std::exception(msg.c_str()));
+		}
+	}
+
+public:
+
+	GReprojector(GFile& f, const cReprojectOptions& options) : O(options) {
+		if (O.srcepsg != 0) {
+			import_epsg(Src, O.srcepsg);
+		}
+		else {
+			NcVar crs = f.hasVar("crs") ? f.getVar("crs") : NcVar();
+			if (crs.isNull() || GVar::hasAtt(crs, "spatial_ref") == false) {
+				std::string msg = _SRC_ + strprint("\nNo source EPSG code given and the file has no crs:spatial_ref to use\n");
+				throw(std::exception(msg.c_str()));
+			}
+			std::string wkt;
+			crs.getAtt("spatial_ref").getValues(wkt);
+			if (Src.importFromWkt(wkt.c_str()) != OGRERR_NONE) {
+				std::string msg = _SRC_ + strprint("\nCould not read the crs:spatial_ref of the file\n");
+				throw(std::exception(msg.c_str()));
+			}
+		}
+		import_epsg(Dst, O.dstepsg);
+		traditional_order(Src);
+		traditional_order(Dst);
+
+		const std::string e = std::to_string(O.dstepsg);
+		if (O.dstxvar.size() == 0) O.dstxvar = geographic() ? "longitude" : "easting_" + e;
+		if (O.dstyvar.size() == 0) O.dstyvar = geographic() ? "latitude" : "northing_" + e;
+		if (O.crsvar.size() == 0) O.crsvar = f.hasVar("crs") ? "crs_" + e : "crs";
+	}
+
+	bool geographic() const { return Dst.IsGeographic() != 0; }
+	const std::string& dstxvar() const { return O.dstxvar; }
+	const std::string& dstyvar() const { return O.dstyvar; }
+
+	//Transform one line in place with a thread's own ct, nulls are NaN
+	static void transform_line(OGRCoordinateTransformation* ct, std::vector<double>& x, std::vector<double>& y) {
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		std::vector<size_t> valid;
+		valid.reserve(x.size());
+		for (size_t si = 0; si < x.size(); si++) {
+			if (x[si] == x[si] && y[si] == y[si]) valid.push_back(si);
+		}
+		if (valid.size() == 0) return;
+
+		std::vector<double> tx(valid.size()), ty(valid.size());
+		for (size_t k = 0; k < valid.size(); k++) {
+			tx[k] = x[valid[k]];
+			ty[k] = y[valid[k]];
+		}
+		std::vector<int> ok(valid.size(), 0);
+		ct->Transform((int)valid.size(), tx.data(), ty.data(), nullptr, ok.data());
+		for (size_t k = 0; k < valid.size(); k++) {
+			x[valid[k]] = ok[k] ? tx[k] : nan;
+			y[valid[k]] = ok[k] ? ty[k] : nan;
+		}
+	}
+
+	void reproject(GFile& f) const {
+		GIOScope scope(f.getId(), "reproject");
+		if (f.hasVar(O.dstxvar) || f.hasVar(O.dstyvar)) {
+			std::string msg = _SRC_ + strprint("\nVariable (%s) or (%s) already exists\n", O.dstxvar.c_str(), O.dstyvar.c_str());
+			throw(std::exception(msg.c_str()));
+		}
+
+		const size_t nt = std::max((size_t)1, std::min(O.nthreads == 0 ? default_nthreads() : O.nthreads, f.nlines()));
+		//Made here, one per thread, as the reference systems are shared and not thread safe
+		std::vector<cTransform> transforms(nt);
+		for (cTransform& tr : transforms) {
+			tr.ct = OGRCreateCoordinateTransformation(&Src, &Dst);
+			if (tr.ct == nullptr) {
+				std::string msg = _SRC_ + strprint("\nCould not create a coordinate transformation to EPSG:%d\n", O.dstepsg);
+				throw(std::exception(msg.c_str()));
+			}
+		}
+
+		//Define the outputs
+		if (f.hasVar(O.crsvar) == false) f.addCRS(O.dstepsg, O.crsvar);
+		const bool geo = geographic();
+		for (const std::string& name : { O.dstxvar, O.dstyvar }) {
+			if (f.addSampleVar(name, ncDouble) == false) {
+				std::string msg = _SRC_ + strprint("\nCould not add variable (%s), a variable of that name may already exist in another case\n", name.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+		}
+		GSampleVar vx = f.getSampleVar(O.dstxvar);
+		GSampleVar vy = f.getSampleVar(O.dstyvar);
+		vx.add_long_name(geo ? "longitude" : "easting");
+		vy.add_long_name(geo ? "latitude" : "northing");
+		vx.add_standard_name(geo ? "longitude" : "projection_x_coordinate");
+		vy.add_standard_name(geo ? "latitude" : "projection_y_coordinate");
+		vx.add_units(geo ? "degrees_east" : "m");
+		vy.add_units(geo ? "degrees_north" : "m");
+		vx.putAtt("grid_mapping", O.crsvar);
+		vy.putAtt("grid_mapping", O.crsvar);
+		const double nullx = vx.missingvalue(double());
+		const double nully = vy.missingvalue(double());
+
+		const size_t nl = f.nlines();
+		std::vector<size_t> weight(nl);
+		for (size_t li = 0; li < nl; li++) weight[li] = f.nlinesamples(li) + 1;
+
+		parallel_for_weighted(weight, [&](const size_t li, const size_t t) {
+			GTraceScope trace("reproject line", li);
+
+			std::vector<double> x, y;
+			{
+				std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+				size_t nb;
+				f.getLineAsDouble(O.xvar, li, x, nb);
+				f.getLineAsDouble(O.yvar, li, y, nb);
+			}
+			if (x.size() == 0) return;
+
+			transform_line(transforms[t].ct, x, y);
+			for (size_t si = 0; si < x.size(); si++) {
+				if (x[si] != x[si] || y[si] != y[si]) {
+					x[si] = nullx;
+					y[si] = nully;
+				}
+			}
+
+			std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+			f.getSampleVar(O.dstxvar).putLine(li, x);
+			f.getSampleVar(O.dstyvar).putLine(li, y);
+		}, nt);
+
+		if (geo) {
+			f.addGeospatialMetadataItem(O.dstxvar, "lon", "degrees_east");
+			f.addGeospatialMetadataItem(O.dstyvar, "lat", "degrees_north");
+		}
+		else {
+			f.addGeospatialMetadataItem(O.dstxvar, "east", "m");
+			f.addGeospatialMetadataItem(O.dstyvar, "north", "m");
+		}
+	}
+};
+
+//Add coordinates reprojected to another crs to a file opened for writing
+inline void reproject(GFile& f, const cReprojectOptions& options) {
+	GReprojector r(f, options);
+	r.reproject(f);
+}
+
+};//endname space
+
+#endif
@@ -0,0 +1,365 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+enum class eResampleMethod {
+	NEAREST,
+	LINEAR
+};
+
+class cResampleOptions {
+public:
+	double spacing = 10.0;//output spacing along the basis
+	std::string basisvar;//resample on this variable (eg a time or fiducial) if set, otherwise on along-line distance
+	std::string xvar = "easting";//coordinates giving the along-line distance
+	std::string yvar = "northing";
+	std::string distancevar = "distance";//output variable for the along-line distance, empty for none
+	eResampleMethod method = eResampleMethod::LINEAR;
+	double maxgap = 0.0;//outputs with no valid input this close along the basis are null, 0 for no limit
+	std::vector<std::string> include_varnames;//sample variables to resample, empty for all
+	std::vector<std::string> exclude_varnames;
+	size_t nthreads = 0;//0 for all cores
+};
+
+// Resamples every line of a file to regular spacing along a basis, either the along-line
+// distance from the x/y coordinates or a monotonic variable such as time or fiducial.
+// Each band of each variable is interpolated separately, skipping its nulls, so a null
+// in one band or variable does not spread to the others. There is no extrapolation past
+// the valid samples of a line.
+// Lines are processed in parallel (see parallel_for_weighted()) and written to a new file
+// with its own line index, line variables are copied unchanged. The lines are read through
+// the source file's handle, so its derived variables can be the basis or coordinates, and
+// the reads are serialised under netcdf_mutex().
+class GResampler {
+
+private:
+
+	cResampleOptions O;
+
+	//Positions along the basis of the samples of one line, basis[si] NaN where unusable
+	class cBasis {
+	public:
+		std::vector<double> u;//basis of each input sample, reversed if decreasing so it always increases
+		std::vector<size_t> valid;//input samples with a usable basis, in order
+		double direction = 1.0;
+		std::vector<double> t;//output positions
+	};
+
+	//Along-line distance, or the basis variable made increasing.
+	//Samples that do not advance along the basis are not used.
+	void make_basis(const std::vector<double>& a, const std::vector<double>& b, cBasis& B) const {
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		const size_t ns = a.size();
+		B.u.assign(ns, nan);
+		B.valid.clear();
+		B.t.clear();
+
+		if (O.basisvar.size() == 0) {
+			double d = 0.0;
+			size_t last = ns;
+			for (size_t si = 0; si < ns; si++) {
+				if (a[si] != a[si] || b[si] != b[si]) continue;
+				if (last < ns) d += std::hypot(a[si] - a[last], b[si] - b[last]);
+				B.u[si] = d;
+				last = si;
+			}
+			B.direction = 1.0;
+		}
+		else {
+			size_t first = ns, last = ns;
+			for (size_t si = 0; si < ns; si++) {
+				if (a[si] != a[si]) continue;
+				if (first == ns) first = si;
+				last = si;
+			}
+			B.direction = (first < ns && a[last] < a[first]) ? -1.0 : 1.0;
+			for (size_t si = 0; si < ns; si++) B.u[si] = B.direction * a[si];
+		}
+
+		for (size_t si = 0; si < ns; si++) {
+			const double u = B.u[si];
+			if (u != u) continue;
+			if (B.valid.size() && u <= B.u[B.valid.back()]) {
+				B.u[si] = nan;
+				continue;
+			}
+			B.valid.push_back(si);
+		}
+
+		if (B.valid.size() == 0) return;
+		const double u0 = B.u[B.valid.front()];
+		const double u1 = B.u[B.valid.back()];
+		const size_t n = (size_t)std::floor((u1 - u0) / O.spacing + 1e-9) + 1;
+		B.t.resize(n);
+		for (size_t k = 0; k < n; k++) B.t[k] = u0 + (double)k * O.spacing;
+	}
+
+	bool within(const double d) const {
+		return O.maxgap <= 0.0 || d <= O.maxgap;
+	}
+
+	//Interpolate band bi of v at t, given the valid basis samples p (left, u <= t) and p+1,
+	//searching outwards when either neighbour is null in this band
+	double slow(const cBasis& B, const std::vector<double>& v, const size_t nb, const size_t bi, const size_t p, const double t) const {
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		size_t l = B.valid.size(), r = B.valid.size();
+		for (size_t q = p + 1; q-- > 0;) {
+			const size_t si = B.valid[q];
+			if (within(t - B.u[si]) == false) break;
+			if (v[si * nb + bi] == v[si * nb + bi]) { l = q; break; }
+		}
+		for (size_t q = p + 1; q < B.valid.size(); q++) {
+			const size_t si = B.valid[q];
+			if (within(B.u[si] - t) == false) break;
+			if (v[si * nb + bi] == v[si * nb + bi]) { r = q; break; }
+		}
+
+		const bool hasl = l < B.valid.size();
+		const bool hasr = r < B.valid.size();
+		if (hasl && B.u[B.valid[l]] == t) return v[B.valid[l] * nb + bi];
+		if (O.method == eResampleMethod::NEAREST) {
+			if (hasl && hasr) {
+				const size_t sl = B.valid[l], sr = B.valid[r];
+				return (t - B.u[sl] <= B.u[sr] - t) ? v[sl * nb + bi] : v[sr * nb + bi];
+			}
+			if (hasl) return v[B.valid[l] * nb + bi];
+			if (hasr) return v[B.valid[r] * nb + bi];
+			return nan;
+		}
+		if (hasl == false || hasr == false) return nan;
+		const size_t sl = B.valid[l], sr = B.valid[r];
+		const double w = (t - B.u[sl]) / (B.u[sr] - B.u[sl]);
+		return v[sl * nb + bi] + w * (v[sr * nb + bi] - v[sl * nb + bi]);
+	}
+
+	struct cVar {
+		std::string name;
+		size_t nbands = 1;
+		bool integer = false;
+		double fill = 0.0;
+	};
+
+	std::vector<cVar> sample_vars(GFile& src) const {
+		for (const std::string& name : O.include_varnames) {
+			if (src.hasDerivedVar(name)) {
+				std::string msg = _SRC_ + strprint("\nDerived variable (%s) cannot be resampled, only stored sample variables can\n", name.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+		}
+		std::vector<cVar> vars;
+		auto vm = src.getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			const NcVar& v = vit->second;
+			const std::string name = v.getName();
+			if (src.isSampleVar(v) == false || name == VN_LINE_INDEX) continue;
+			if (O.include_varnames.size() > 0 && src.isinlist(O.include_varnames, name) == false) continue;
+			if (O.exclude_varnames.size() > 0 && src.isinlist(O.exclude_varnames, name)) continue;
+			cVar c;
+			c.name = name;
+			const GVar g(src, v);
+			c.nbands = g.elementspersample();
+			const nc_type t = v.getType().getId();
+			c.integer = (t != NC_FLOAT && t != NC_DOUBLE);
+			c.fill = g.missingvalue(double());
+			vars.push_back(c);
+		}
+		return vars;
+	}
+
+	void read_basis(GFile& f, const size_t li, std::vector<double>& a, std::vector<double>& b) const {
+		size_t nb;
+		if (O.basisvar.size()) {
+			f.getLineAsDouble(O.basisvar, li, a, nb);
+			b.clear();
+		}
+		else {
+			f.getLineAsDouble(O.xvar, li, a, nb);
+			f.getLineAsDouble(O.yvar, li, b, nb);
+		}
+	}
+
+	//Runs f(li) over the lines in parallel, f reads through the source file under netcdf_mutex()
+	template<typename F>
+	void for_lines(const std::vector<size_t>& weight, F f) const {
+		const size_t nt = std::max((size_t)1, std::min(O.nthreads == 0 ? default_nthreads() : O.nthreads, weight.size()));
+		parallel_for_weighted(weight, [&](const size_t li, const size_t) { f(li); }, nt);
+	}
+
+	//Chunking and compression of an output variable as its source, with chunks no larger than the output dimensions
+	static void copy_storage(const NcVar& srcvar, NcVar& v) {
+		const std::vector<NcDim> dims = v.getDims();
+		if (dims.size() == 0) return;
+		NcVar::ChunkMode mode;
+		std::vector<size_t> chunksizes;
+		srcvar.getChunkingParameters(mode, chunksizes);
+		if (mode == NcVar::nc_CHUNKED && chunksizes.size() == dims.size()) {
+			bool empty = false;
+			for (size_t di = 0; di < dims.size(); di++) {
+				const size_t n = dims[di].getSize();
+				if (n == 0) empty = true;
+				else chunksizes[di] = std::max((size_t)1, std::min(chunksizes[di], n));
+			}
+			if (empty == false) v.setChunking(mode, chunksizes);
+		}
+		bool shuffle, deflate;
+		int level;
+		srcvar.getCompressionParameters(shuffle, deflate, level);
+		if (deflate) v.setCompression(shuffle, deflate, level);
+	}
+
+public:
+
+	GResampler(const cResampleOptions& options) : O(options) {
+		if (!(O.spacing > 0.0)) {
+			std::string msg = _SRC_ + strprint("\nResample spacing must be positive\n");
+			throw(std::exception(msg.c_str()));
+		}
+	}
+
+	//Output positions along the basis for one line, see resample_line()
+	void basis(const std::vector<double>& a, const std::vector<double>& b, std::vector<double>& t) const {
+		cBasis B;
+		make_basis(a, b, B);
+		t = B.t;
+	}
+
+	//Resample one line of a variable with nb bands (sample major, nulls NaN) given its basis
+	//inputs a (distance: x, time: the basis variable) and b (distance: y, otherwise unused)
+	void resample_line(const std::vector<double>& a, const std::vector<double>& b, const std::vector<double>& v, const size_t nb, std::vector<double>& out) const {
+		cBasis B;
+		make_basis(a, b, B);
+		resample(B, v, nb, out);
+	}
+
+private:
+
+	void resample(const cBasis& B, const std::vector<double>& v, const size_t nb, std::vector<double>& out) const {
+		const size_t m = B.t.size();
+		out.resize(m * nb);
+		size_t p = 0;
+		for (size_t k = 0; k < m; k++) {
+			const double t = B.t[k];
+			while (p + 1 < B.valid.size() && B.u[B.valid[p + 1]] <= t) p++;
+			const size_t sl = B.valid[p];
+			const size_t sr = B.valid[std::min(p + 1, B.valid.size() - 1)];
+			const double ul = B.u[sl], ur = B.u[sr];
+			const double w = ur > ul ? (t - ul) / (ur - ul) : 0.0;
+			const bool near = within(t - ul) && within(ur - t);
+			const double* vl = &v[sl * nb];
+			const double* vr = &v[sr * nb];
+			double* o = &out[k * nb];
+			if (O.method == eResampleMethod::LINEAR) {
+				for (size_t bi = 0; bi < nb; bi++) o[bi] = vl[bi] + w * (vr[bi] - vl[bi]);
+			}
+			else {
+				const double* vn = (w <= 0.5) ? vl : vr;
+				for (size_t bi = 0; bi < nb; bi++) o[bi] = vn[bi];
+			}
+			//NaN where a neighbour is null or too far away
+			for (size_t bi = 0; bi < nb; bi++) {
+				if (o[bi] != o[bi] || near == false) o[bi] = slow(B, v, nb, bi, p, t);
+			}
+		}
+	}
+
+public:
+
+	//Create dst (a new empty file) from src resampled line by line
+	void resample(GFile& src, GFile& dst) const {
+		GIOScope scope(src.getId(), "resample");
+		const size_t nl = src.nlines();
+		const std::vector<cVar> vars = sample_vars(src);
+		const bool writedistance = O.basisvar.size() == 0 && O.distancevar.size() > 0 && src.hasVar(O.distancevar) == false;
+
+		//First pass counts the output samples of each line
+		std::vector<size_t> weight(nl);
+		for (size_t li = 0; li < nl; li++) weight[li] = src.nlinesamples(li) + 1;
+		std::vector<unsigned int> count(nl);
+		for_lines(weight, [&](const size_t li) {
+			std::vector<double> a, b;
+			{
+				std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+				read_basis(src, li, a, b);
+			}
+			cBasis B;
+			make_basis(a, b, B);
+			count[li] = (unsigned int)B.t.size();
+		});
+
+		std::vector<int> srcnumbers = src.getLineNumbers();
+		std::vector<unsigned int> linenumbers(srcnumbers.begin(), srcnumbers.end());
+		dst.InitialiseNew(linenumbers, count);
+		dst.copy_dims(src);
+		dst.copy_global_atts(src);
+		auto vm = src.getVars();
+		for (auto vit = vm.begin(); vit != vm.end(); vit++) {
+			const NcVar& v = vit->second;
+			if (src.isLineVar(v) && v.getName() != DN_LINE && v.getName() != VN_LI_START && v.getName() != VN_LI_COUNT) {
+				dst.copy_var(1, v);
+			}
+		}
+		for (const cVar& c : vars) {
+			const NcVar srcvar = src.getVar(c.name);
+			std::vector<NcDim> dims = srcvar.getDims();
+			for (size_t di = 0; di < dims.size(); di++) dims[di] = dst.getDim(dims[di].getName());
+			NcVar v = dst.addVar(c.name, srcvar.getType(), dims);
+			copy_storage(srcvar, v);
+			dst.copy_varatts(srcvar, v);
+		}
+		if (writedistance) {
+			dst.addSampleVar(O.distancevar, ncDouble);
+			GSampleVar d = dst.getSampleVar(O.distancevar);
+			d.add_long_name("distance along line");
+			d.add_units("m");
+		}
+
+		//Second pass resamples and writes each line
+		for (size_t li = 0; li < nl; li++) weight[li] = (size_t)count[li] + src.nlinesamples(li) + 1;
+		for_lines(weight, [&](const size_t li) {
+			GTraceScope trace("resample line", li);
+			std::vector<double> a, b;
+			std::vector<std::vector<double>> in(vars.size());
+			{
+				std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+				read_basis(src, li, a, b);
+				size_t nb;
+				for (size_t vi = 0; vi < vars.size(); vi++) src.getLineAsDouble(vars[vi].name, li, in[vi], nb);
+			}
+
+			cBasis B;
+			make_basis(a, b, B);
+			std::vector<std::vector<double>> out(vars.size());
+			for (size_t vi = 0; vi < vars.size(); vi++) {
+				resample(B, in[vi], vars[vi].nbands, out[vi]);
+				for (double& d : out[vi]) {
+					if (d != d) d = vars[vi].fill;
+					else if (vars[vi].integer) d = std::round(d);
+				}
+			}
+
+			std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+			if (B.t.size() == 0) return;
+			for (size_t vi = 0; vi < vars.size(); vi++) {
+				GSampleVar v = dst.getSampleVar(vars[vi].name);
+				v.putLine(li, out[vi]);
+			}
+			if (writedistance) {
+				std::vector<double> t(B.t);
+				for (double& d : t) d -= B.t[0];
+				dst.getSampleVar(O.distancevar).putLine(li, t);
+			}
+		});
+	}
+};
+
+};//endname space
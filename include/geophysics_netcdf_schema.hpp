@@ -0,0 +1,211 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+// Compile-time description of the variables a tool uses, for example
+//
+//	struct Height : GField<float> { static constexpr const char* name = "height"; };
+//	struct EMX : GField<double, 45> { static constexpr const char* name = "em_x"; };
+//	struct Flight : GField<int, 1, eVarKind::line> { static constexpr const char* name = "flight"; };
+//	using MySchema = GSchema<Height, EMX, Flight>;
+//
+//	GFile f(path);
+//	const MySchema s = f.bind<MySchema>();
+//	std::vector<float> h;
+//	s.get<Height>().getLine(li, h);
+//
+// Element types are checked at compile time, names, kinds, types and band
+// counts are checked against the file once by bind(). The typed handles then
+// call the matching nc_get_vara_<type> function directly with no name lookup
+// or type dispatch.
+
+enum class eVarKind { sample, line };
+
+// Only the element types supported by the format have a specialisation,
+// using any other type is a compile error
+template<typename T> struct nc_traits;
+
+#define GEOPHYSICS_NETCDF_TRAITS(T, ID, SUFFIX) \
+template<> struct nc_traits<T> { \
+	static constexpr nc_type id = ID; \
+	static int get(int ncid, int varid, const size_t* start, const size_t* count, T* v) { return nc_get_vara_##SUFFIX(ncid, varid, start, count, v); } \
+	static int put(int ncid, int varid, const size_t* start, const size_t* count, const T* v) { return nc_put_vara_##SUFFIX(ncid, varid, start, count, v); } \
+};
+
+GEOPHYSICS_NETCDF_TRAITS(uint8_t, NC_UBYTE, uchar)
+GEOPHYSICS_NETCDF_TRAITS(int8_t, NC_BYTE, schar)
+GEOPHYSICS_NETCDF_TRAITS(short, NC_SHORT, short)
+GEOPHYSICS_NETCDF_TRAITS(int, NC_INT, int)
+GEOPHYSICS_NETCDF_TRAITS(unsigned int, NC_UINT, uint)
+GEOPHYSICS_NETCDF_TRAITS(float, NC_FLOAT, float)
+GEOPHYSICS_NETCDF_TRAITS(double, NC_DOUBLE, double)
+
+#undef GEOPHYSICS_NETCDF_TRAITS
+
+template<typename T, size_t NBANDS = 1, eVarKind KIND = eVarKind::sample>
+struct GField {
+	static_assert(NBANDS > 0, "A GField must have at least one band");
+	using type = T;
+	static constexpr nc_type nctype = nc_traits<T>::id;
+	static constexpr size_t bands = NBANDS;
+	static constexpr eVarKind kind = KIND;
+};
+
+template<typename F>
+class GTypedVar {
+
+public:
+	using type = typename F::type;
+
+private:
+	const GFile* File = nullptr;
+	int GroupId = -1;
+	int VarId = -1;
+	size_t NDims = 1;
+	type MissingValue = type();
+
+	static void check(const int status, const char* action) {
+		if (status != NC_NOERR) {
+			std::string msg = _SRC_ + strprint("\nCould not %s variable (%s): %s\n", action, F::name, nc_strerror(status));
+			throw(std::exception(msg.c_str()));
+		}
+	}
+
+	void hyperslab(const size_t lineindex, size_t* start, size_t* count) const {
+		if (F::kind == eVarKind::sample) {
+			start[0] = File->get_line_index_start(lineindex);
+			count[0] = File->get_line_index_count(lineindex);
+		}
+		else {
+			start[0] = lineindex;
+			count[0] = 1;
+		}
+		start[1] = 0;
+		count[1] = F::bands;
+	}
+
+public:
+
+	GTypedVar() {};
+
+	explicit GTypedVar(const GFile& file) {
+		const GVar v(file, file.getVar(F::name));
+		if (v.isNull()) {
+			std::string msg = _SRC_ + strprint("\nSchema variable (%s) is not in the file\n", F::name);
+			throw(std::exception(msg.c_str()));
+		}
+
+		const bool kindok = F::kind == eVarKind::sample ? v.isSampleVar() : v.isLineVar();
+		if (kindok == false) {
+			std::string msg = _SRC_ + strprint("\nSchema variable (%s) is not a %s variable\n", F::name, F::kind == eVarKind::sample ? DN_POINT : DN_LINE);
+			throw(std::exception(msg.c_str()));
+		}
+
+		if (v.getType().getId() != F::nctype) {
+			std::string msg = _SRC_ + strprint("\nSchema variable (%s) has type %s in the file\n", F::name, v.getType().getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+
+		NDims = (size_t)v.getDimCount();
+		if (NDims > 2 || (NDims == 1 && F::bands != 1) || (NDims == 2 && v.getDim(1).getSize() != F::bands)) {
+			std::string msg = _SRC_ + strprint("\nSchema variable (%s) does not have %zu bands in the file\n", F::name, F::bands);
+			throw(std::exception(msg.c_str()));
+		}
+
+		File = &file;
+		GroupId = v.getParentGroup().getId();
+		VarId = v.getId();
+		MissingValue = v.missingvalue(MissingValue);
+	}
+
+	const char* name() const { return F::name; }
+
+	constexpr size_t nbands() const { return F::bands; }
+
+	type missingvalue() const { return MissingValue; }
+
+	bool getLine(const size_t& lineindex, std::vector<type>& vals) const {
+		size_t start[2], count[2];
+		hyperslab(lineindex, start, count);
+		vals.resize(count[0] * F::bands);
+		if (vals.size() == 0) return true;
+		check(nc_traits<type>::get(GroupId, VarId, start, count, vals.data()), "read");
+		return true;
+	}
+
+	bool putLine(const size_t& lineindex, const std::vector<type>& vals) const {
+		size_t start[2], count[2];
+		hyperslab(lineindex, start, count);
+		if (vals.size() != count[0] * F::bands) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write line of variable (%s) with non-matching size\n", F::name);
+			throw(std::exception(msg.c_str()));
+		}
+		if (vals.size() == 0) return true;
+		check(nc_traits<type>::put(GroupId, VarId, start, count, vals.data()), "write");
+		return true;
+	}
+
+	type getSample(const size_t& lineindex, const size_t& sampleindex, const size_t& bandindex = 0) const {
+		size_t start[2], count[2];
+		hyperslab(lineindex, start, count);
+		start[0] += (F::kind == eVarKind::sample) ? sampleindex : 0;
+		start[1] = bandindex;
+		count[0] = count[1] = 1;
+		type v;
+		check(nc_traits<type>::get(GroupId, VarId, start, count, &v), "read");
+		return v;
+	}
+
+	bool getRecord(const size_t& record, std::vector<type>& vals) const {
+		size_t start[2] = { record, 0 };
+		size_t count[2] = { 1, F::bands };
+		vals.resize(F::bands);
+		check(nc_traits<type>::get(GroupId, VarId, start, count, vals.data()), "read");
+		return true;
+	}
+
+	bool putRecord(const size_t& record, const std::vector<type>& vals) const {
+		if (vals.size() != F::bands) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write record of variable (%s) with non-matching size\n", F::name);
+			throw(std::exception(msg.c_str()));
+		}
+		size_t start[2] = { record, 0 };
+		size_t count[2] = { 1, F::bands };
+		check(nc_traits<type>::put(GroupId, VarId, start, count, vals.data()), "write");
+		return true;
+	}
+};
+
+template<typename... Fields>
+class GSchema {
+
+private:
+	std::tuple<GTypedVar<Fields>...> Vars;
+
+public:
+
+	explicit GSchema(const GFile& file)
+		: Vars(GTypedVar<Fields>(file)...)
+	{};
+
+	static constexpr size_t size() { return sizeof...(Fields); }
+
+	template<typename F>
+	const GTypedVar<F>& get() const {
+		return std::get<GTypedVar<F>>(Vars);
+	}
+};
+
+};//endname space
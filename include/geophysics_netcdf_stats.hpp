@@ -0,0 +1,404 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <netcdf>
+#include "geophysics_netcdf_parallel.hpp"
+
+namespace GeophysicsNetCDF {
+
+// Counters for one API on one variable of one file
+class cIOStat {
+public:
+	std::string api;
+	std::string var;//empty for file level operations
+	size_t calls = 0;
+	size_t elements = 0;
+	size_t bytes = 0;//in the variable's type on disk
+	double seconds = 0.0;
+};
+
+// Optional I/O instrumentation, off by default.
+// When enabled the library's read, write and copy APIs count their calls,
+// elements, bytes and wall time per file, per API and per variable. Only the
+// outermost instrumented call is counted, so an API implemented with other APIs,
+// or with parallel_for() workers, is not counted twice. Variables in sub-groups
+// are counted against their file. When disabled the cost is one
+// relaxed atomic load per call.
+class GIOStats {
+
+private:
+
+	std::atomic<bool> Enabled{ false };
+	mutable std::mutex Mutex;
+	std::map<int, std::map<std::pair<std::string, std::string>, cIOStat>> Files;//by netCDF id then (api, variable)
+	bool DumpOnClose = false;
+	std::string DumpDirectory;
+
+public:
+
+	static std::string json_string(const std::string& s) {
+		std::string o = "\"";
+		for (const char c : s) {
+			if (c == '"' || c == '\\') { o += '\\'; o += c; }
+			else if ((unsigned char)c < 0x20) { char b[8]; std::snprintf(b, sizeof(b), "\\u%04x", c); o += b; }
+			else o += c;
+		}
+		return o + "\"";
+	}
+
+	static GIOStats& global() {
+		static GIOStats s;
+		return s;
+	}
+
+	bool enabled() const { return Enabled.load(std::memory_order_relaxed); }
+
+	void enable(const bool on = true) { Enabled = on; }
+
+	//Write the statistics of each file as JSON when it is closed, to <directory>/<filename>.iostats.json
+	//or, if directory is empty, next to the file
+	void dump_on_close(const bool on, const std::string& directory = std::string()) {
+		std::lock_guard<std::mutex> lock(Mutex);
+		DumpOnClose = on;
+		DumpDirectory = directory;
+	}
+
+	void record(const int ncid, const std::string& api, const std::string& var, const size_t elements, const size_t bytes, const double seconds) {
+		std::lock_guard<std::mutex> lock(Mutex);
+		cIOStat& s = Files[ncid][std::make_pair(api, var)];
+		if (s.calls == 0) {
+			s.api = api;
+			s.var = var;
+		}
+		s.calls++;
+		s.elements += elements;
+		s.bytes += bytes;
+		s.seconds += seconds;
+	}
+
+	std::vector<cIOStat> snapshot(const int ncid) const {
+		std::lock_guard<std::mutex> lock(Mutex);
+		std::vector<cIOStat> v;
+		auto it = Files.find(ncid);
+		if (it == Files.end()) return v;
+		for (const auto& s : it->second) v.push_back(s.second);
+		return v;
+	}
+
+	bool has(const int ncid) const {
+		std::lock_guard<std::mutex> lock(Mutex);
+		return Files.find(ncid) != Files.end();
+	}
+
+	void clear(const int ncid) {
+		std::lock_guard<std::mutex> lock(Mutex);
+		Files.erase(ncid);
+	}
+
+	static std::string to_json(const std::string& path, const std::vector<cIOStat>& stats) {
+		std::map<std::string, cIOStat> byvar;
+		std::map<std::string, cIOStat> byapi;
+		for (const cIOStat& s : stats) {
+			for (cIOStat* t : { &byvar[s.var], &byapi[s.api] }) {
+				t->calls += s.calls;
+				t->elements += s.elements;
+				t->bytes += s.bytes;
+				t->seconds += s.seconds;
+			}
+		}
+
+		auto counters = [](const cIOStat& s) {
+			char b[160];
+			std::snprintf(b, sizeof(b), "\"calls\": %zu, \"elements\": %zu, \"bytes\": %zu, \"seconds\": %.6f", s.calls, s.elements, s.bytes, s.seconds);
+			return std::string(b);
+		};
+
+		std::string j = "{\n  \"file\": " + json_string(path) + ",\n  \"calls\": [";
+		for (size_t i = 0; i < stats.size(); i++) {
+			j += (i ? ",\n    " : "\n    ");
+			j += "{\"api\": " + json_string(stats[i].api) + ", \"var\": " + json_string(stats[i].var) + ", " + counters(stats[i]) + "}";
+		}
+		j += "\n  ],\n  \"by_variable\": {";
+		size_t k = 0;
+		for (const auto& s : byvar) {
+			j += (k++ ? ",\n    " : "\n    ") + json_string(s.first) + ": {" + counters(s.second) + "}";
+		}
+		j += "\n  },\n  \"by_api\": {";
+		k = 0;
+		for (const auto& s : byapi) {
+			j += (k++ ? ",\n    " : "\n    ") + json_string(s.first) + ": {" + counters(s.second) + "}";
+		}
+		j += "\n  }\n}\n";
+		return j;
+	}
+
+	//Called as a file closes, dumps its statistics if requested and forgets them
+	void close(const int ncid, const std::string& path) {
+		bool dump;
+		std::string dir;
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			if (Files.find(ncid) == Files.end()) return;
+			dump = DumpOnClose;
+			dir = DumpDirectory;
+		}
+
+		if (dump && path.size()) {
+			std::string out = path;
+			if (dir.size()) {
+				const size_t p = path.find_last_of("/\\");
+				out = dir + "/" + (p == std::string::npos ? path : path.substr(p + 1));
+			}
+			std::ofstream of(out + ".iostats.json");
+			of << to_json(path, snapshot(ncid));
+		}
+		clear(ncid);
+	}
+};
+
+// Optional timeline of scoped events in the Chrome trace-event JSON format,
+// viewable in chrome://tracing or Perfetto. Every GIOScope (including nested
+// ones) and every GTraceScope becomes one complete ("X") event on the timeline
+// of the thread it ran on. Events are held in memory and written by stop(),
+// or when the program exits if the trace is still running.
+class GTrace {
+
+private:
+
+	std::atomic<bool> Enabled{ false };
+	std::mutex Mutex;
+	std::string Path;
+	std::vector<std::string> Events;
+	std::chrono::steady_clock::time_point T0 = std::chrono::steady_clock::now();
+	std::atomic<int> NextThreadId{ 1 };
+
+	GTrace() {}
+
+public:
+
+	static GTrace& global() {
+		static GTrace t;
+		return t;
+	}
+
+	~GTrace() {
+		try {
+			stop();
+		}
+		catch (...) {
+		}
+	}
+
+	bool enabled() const { return Enabled.load(std::memory_order_relaxed); }
+
+	//Start recording, discarding any earlier events
+	void start(const std::string& path) {
+		std::lock_guard<std::mutex> lock(Mutex);
+		Path = path;
+		Events.clear();
+		T0 = std::chrono::steady_clock::now();
+		Enabled = true;
+	}
+
+	//Stop recording and write the trace file
+	bool stop() {
+		std::lock_guard<std::mutex> lock(Mutex);
+		if (Enabled == false) return false;
+		Enabled = false;
+		std::ofstream of(Path);
+		if (!of) return false;
+		of << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+		for (int tid = 1; tid < NextThreadId; tid++) {
+			of << (tid > 1 ? ",\n" : "\n");
+			of << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"name\": \"thread " << tid << "\"}}";
+		}
+		for (size_t i = 0; i < Events.size(); i++) {
+			of << (i || NextThreadId > 1 ? ",\n" : "\n") << Events[i];
+		}
+		of << "\n]}\n";
+		Events.clear();
+		return true;
+	}
+
+	//Small sequential id of the calling thread
+	int thread_id() {
+		thread_local int id = NextThreadId++;
+		return id;
+	}
+
+	//Microseconds since the trace started
+	double now() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - T0).count();
+	}
+
+	//Record a complete event, args is the body of a JSON object (may be empty)
+	void complete(const char* name, const char* category, const double start, const double duration, const std::string& args) {
+		const int tid = thread_id();
+		char b[256];
+		std::snprintf(b, sizeof(b), "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d, \"args\": {",
+			name, category, start, duration, tid);
+		std::string e = b + args + "}}";
+		std::lock_guard<std::mutex> lock(Mutex);
+		if (Enabled) Events.push_back(std::move(e));
+	}
+};
+
+// Scope guard adding a compute (non I/O) phase to the trace, it is inert while tracing is off
+class GTraceScope {
+
+private:
+
+	const char* Name;
+	bool Active = false;
+	double Start = 0.0;
+	size_t Index = 0;
+	bool HaveIndex = false;
+
+public:
+
+	GTraceScope(const char* name) : Name(name) {
+		if (GTrace::global().enabled() == false) return;
+		Active = true;
+		Start = GTrace::global().now();
+	}
+
+	//A phase for one item, e.g. one line
+	GTraceScope(const char* name, const size_t index) : GTraceScope(name) {
+		Index = index;
+		HaveIndex = true;
+	}
+
+	GTraceScope(const GTraceScope&) = delete;
+	GTraceScope& operator=(const GTraceScope&) = delete;
+
+	~GTraceScope() {
+		if (Active == false) return;
+		GTrace& t = GTrace::global();
+		char b[48] = "";
+		if (HaveIndex) std::snprintf(b, sizeof(b), "\"index\": %zu", Index);
+		try {
+			t.complete(Name, "compute", Start, t.now() - Start, b);
+		}
+		catch (...) {
+		}
+	}
+};
+
+// Scope guard timing one instrumented API call for GIOStats and GTrace,
+// it is inert while both are off
+class GIOScope {
+
+private:
+
+	bool Active = false;//counted in GIOStats
+	bool Nested = false;//counted in the thread's depth
+	bool Tracing = false;
+	double TraceStart = 0.0;
+	int NcId = 0;
+	const char* Api = nullptr;
+	const netCDF::NcVar* Var = nullptr;
+	std::string VarName;
+	size_t Elements = 0;
+	size_t Bytes = 0;
+	bool HaveBytes = false;
+	std::chrono::steady_clock::time_point Start;
+
+	static int& depth() {
+		return io_scope_depth();
+	}
+
+	//The root group of the file holding group ncid
+	static int root_id(int ncid) {
+		int parent;
+		while (nc_inq_grp_parent(ncid, &parent) == NC_NOERR) ncid = parent;
+		return ncid;
+	}
+
+	void begin() {
+		if (GTrace::global().enabled()) {
+			Tracing = true;
+			TraceStart = GTrace::global().now();
+		}
+		if (GIOStats::global().enabled() == false) return;
+		Nested = true;
+		if (depth()++ > 0) return;//inside another instrumented call
+		Active = true;
+		Start = std::chrono::steady_clock::now();
+	}
+
+public:
+
+	//A call on a variable
+	GIOScope(const netCDF::NcVar& var, const char* api) : Api(api), Var(&var) {
+		begin();
+	}
+
+	//A file level call, optionally attributed to a named variable
+	GIOScope(const int ncid, const char* api, const std::string& varname = std::string()) : NcId(ncid), Api(api), VarName(varname) {
+		begin();
+	}
+
+	GIOScope(const GIOScope&) = delete;
+	GIOScope& operator=(const GIOScope&) = delete;
+
+	//Attribute a file level call to a file that was opened after the scope began
+	void file(const int ncid) { NcId = ncid; }
+
+	//Elements transferred, bytes are taken from the variable's type
+	void count(const size_t elements) {
+		Elements += elements;
+	}
+
+	void count(const size_t elements, const size_t bytes) {
+		Elements += elements;
+		Bytes += bytes;
+		HaveBytes = true;
+	}
+
+	~GIOScope() {
+		if (Nested) depth()--;
+		if (Active == false && Tracing == false) return;
+
+		const double seconds = Active ? std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count() : 0.0;
+		try {
+			std::string name = VarName;
+			size_t bytes = Bytes;
+			int ncid = NcId;
+			{
+				std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+				if (Var && Var->isNull() == false) {
+					name = Var->getName();
+					ncid = Var->getParentGroup().getId();
+					if (HaveBytes == false) bytes = Elements * Var->getType().getSize();
+				}
+				ncid = root_id(ncid);
+			}
+			if (Active) GIOStats::global().record(ncid, Api, name, Elements, bytes, seconds);
+			if (Tracing) {
+				GTrace& t = GTrace::global();
+				char b[96];
+				std::snprintf(b, sizeof(b), "\"elements\": %zu, \"bytes\": %zu, \"var\": ", Elements, bytes);
+				t.complete(Api, "io", TraceStart, t.now() - TraceStart, b + GIOStats::json_string(name));
+			}
+		}
+		catch (...) {
+		}
+	}
+};
+
+};//endname space
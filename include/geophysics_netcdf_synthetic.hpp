@@ -0,0 +1,223 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include "geophysics_netcdf.hpp"
+#include "geophysics_netcdf_writer.hpp"
+
+namespace GeophysicsNetCDF {
+
+// Small fast generator with a fixed algorithm (SplitMix64) so that the same
+// seed gives the same random sequence on every platform and compiler. The survey
+// values are made from it with std::sin, exp and log, so they may differ in the
+// last bits between C libraries.
+class cSplitMix64 {
+
+private:
+	uint64_t State;
+
+public:
+
+	explicit cSplitMix64(const uint64_t seed) : State(seed) {}
+
+	uint64_t next() {
+		uint64_t z = (State += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	//Uniform in [0,1)
+	double uniform() {
+		return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	//Standard normal (Box-Muller)
+	double normal() {
+		const double u1 = 1.0 - uniform();
+		const double u2 = uniform();
+		return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+	}
+};
+
+class cSyntheticOptions {
+public:
+	size_t nlines = 100;
+	size_t meansamples = 10000;//mean number of samples per line
+	double lengthspread = 0.3;//line lengths are uniform within +/- this fraction of the mean
+	size_t nbands = 30;//bands of the multiband "em" variable
+	NcType datatype = ncFloat;//type of the data variables, coordinates are always double
+	double nullfraction = 0.0;//probability that a data sample is null
+	size_t chunkrows = 16384;//chunk size of the point dimension, 0 for contiguous
+	int deflatelevel = 0;//0 for no compression
+	uint64_t seed = 1;
+	double linespacing = 200.0;//metres
+	double samplespacing = 7.0;//metres
+};
+
+// Writes a synthetic airborne survey of parallel lines with the variables
+//   line   : flight (int), bearing (float)
+//   sample : fiducial, easting, northing (double), height, dem, mag (datatype)
+//            and em (datatype, nbands)
+// Integer datatypes hold em in thousandths and the other data variables rounded.
+// Every line is generated from its own seed, so the output does not depend on
+// the order lines are generated in and any single line can be regenerated.
+// Data are written a line at a time through a GBufferedWriter, so memory use
+// is independent of the size of the survey. No other netCDF calls are made on
+// the file until the writer is closed.
+class GSyntheticSurvey {
+
+private:
+
+	cSyntheticOptions O;
+
+	uint64_t line_seed(const size_t li) const {
+		cSplitMix64 r(O.seed ^ (0xD1B54A32D192ED03ULL * (uint64_t)(li + 1)));
+		return r.next();
+	}
+
+	void define(GFile& f, const std::string& name, const size_t nbands) const {
+		if (O.chunkrows == 0) return;
+		NcVar v = f.getVar(name);
+		std::vector<size_t> chunks = { O.chunkrows };
+		if (nbands > 1) chunks.push_back(nbands);
+		v.setChunking(NcVar::nc_CHUNKED, chunks);
+		if (O.deflatelevel > 0) v.setCompression(true, true, O.deflatelevel);
+	}
+
+	double em_scale() const {
+		const nc_type t = O.datatype.getId();
+		return (t == NC_FLOAT || t == NC_DOUBLE) ? 1.0 : 1000.0;
+	}
+
+public:
+
+	GSyntheticSurvey(const cSyntheticOptions& options) : O(options) {}
+
+	const cSyntheticOptions& options() const { return O; }
+
+	size_t line_count(const size_t li) const {
+		cSplitMix64 r(line_seed(li));
+		const double f = 1.0 + O.lengthspread * (2.0 * r.uniform() - 1.0);
+		return std::max((size_t)1, (size_t)std::llround(f * (double)O.meansamples));
+	}
+
+	unsigned int line_number(const size_t li) const {
+		return (unsigned int)(100010 + 10 * li);
+	}
+
+	//Generate one line, fid/x/y/z/dem/mag are nsamples long and em nsamples x nbands.
+	//Nulls are NaN.
+	void line(const size_t li, std::vector<double>& fid, std::vector<double>& x, std::vector<double>& y,
+		std::vector<double>& z, std::vector<double>& dem, std::vector<double>& mag, std::vector<double>& em) const
+	{
+		const size_t ns = line_count(li);
+		const size_t nb = O.nbands;
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		cSplitMix64 r(line_seed(li) + 1);
+		fid.resize(ns); x.resize(ns); y.resize(ns);
+		z.resize(ns); dem.resize(ns); mag.resize(ns); em.resize(ns * nb);
+
+		//Alternate lines are flown in opposite directions
+		const double dir = (li % 2) ? -1.0 : 1.0;
+		const double x0 = 500000.0 + (dir < 0 ? (double)ns * O.samplespacing : 0.0);
+		double drift = 0.0, ground = 300.0 + 50.0 * r.uniform(), h = 120.0;
+		double rmi = 100.0 * r.normal();
+		for (size_t si = 0; si < ns; si++) {
+			fid[si] = 1000.0 * (double)li + 0.1 * (double)si;
+			x[si] = x0 + dir * O.samplespacing * (double)si + 0.5 * r.normal();
+			drift += 0.05 * r.normal();
+			y[si] = 7000000.0 + O.linespacing * (double)li + drift;
+			ground += 0.5 * r.normal();
+			h += 0.2 * (120.0 - h) + 2.0 * r.normal();
+			dem[si] = ground;
+			z[si] = ground + h;
+			rmi += 0.8 * r.normal();
+			mag[si] = rmi;
+			const double conductance = 1.0 + 0.5 * std::sin(0.001 * x[si] + 0.3 * (double)li);
+			for (size_t bi = 0; bi < nb; bi++) {
+				em[si * nb + bi] = conductance * std::exp(-0.15 * (double)bi) * (1.0 + 0.02 * r.normal());
+			}
+
+			if (O.nullfraction > 0.0) {
+				if (r.uniform() < O.nullfraction) mag[si] = nan;
+				if (r.uniform() < O.nullfraction) dem[si] = nan;
+				if (r.uniform() < O.nullfraction) {
+					for (size_t bi = 0; bi < nb; bi++) em[si * nb + bi] = nan;
+				}
+			}
+		}
+	}
+
+	//Create the survey file
+	void write(const std::string& path) const {
+		std::vector<unsigned int> linenumbers(O.nlines);
+		std::vector<unsigned int> counts(O.nlines);
+		for (size_t li = 0; li < O.nlines; li++) {
+			linenumbers[li] = line_number(li);
+			counts[li] = (unsigned int)line_count(li);
+		}
+
+		GFile f(path, NcFile::replace);
+		f.InitialiseNew(linenumbers, counts);
+		NcDim band = f.addDim("em_window", O.nbands);
+		f.addLineVar("flight", ncInt);
+		f.addLineVar("bearing", ncFloat);
+		const std::vector<std::string> coords = { "fiducial", "easting", "northing" };
+		const std::vector<std::string> data = { "height", "dem", "mag" };
+		for (const std::string& name : coords) {
+			f.addSampleVar(name, ncDouble);
+			define(f, name, 1);
+		}
+		for (const std::string& name : data) {
+			f.addSampleVar(name, O.datatype);
+			define(f, name, 1);
+		}
+		f.addSampleVar("em", O.datatype, band);
+		define(f, "em", O.nbands);
+
+		GLineVar flight = f.getLineVar("flight");
+		GLineVar bearing = f.getLineVar("bearing");
+		std::vector<int> fl(O.nlines);
+		std::vector<float> br(O.nlines);
+		for (size_t li = 0; li < O.nlines; li++) {
+			fl[li] = (int)(li / 20 + 1);
+			br[li] = (li % 2) ? 270.0f : 90.0f;
+		}
+		flight.putAll(fl);
+		bearing.putAll(br);
+
+		std::vector<GSampleVar> vars;
+		for (const std::string& name : coords) vars.push_back(f.getSampleVar(name));
+		for (const std::string& name : data) vars.push_back(f.getSampleVar(name));
+		vars.push_back(f.getSampleVar("em"));
+
+		std::vector<double> nullvalue(vars.size());
+		for (size_t vi = 0; vi < vars.size(); vi++) {
+			nullvalue[vi] = vars[vi].missingvalue(nullvalue[vi]);
+		}
+
+		const bool integer = em_scale() != 1.0;
+		GBufferedWriter w(f);
+		std::vector<std::vector<double>> v(vars.size());
+		for (size_t li = 0; li < O.nlines; li++) {
+			line(li, v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+			for (size_t vi = 3; vi < vars.size(); vi++) {
+				//Scale the data variables, round them for integer types and replace nulls
+				const double k = (vi == 6) ? em_scale() : 1.0;
+				for (double& d : v[vi]) d = (d != d) ? nullvalue[vi] : (integer ? std::round(d * k) : d * k);
+			}
+			for (size_t vi = 0; vi < vars.size(); vi++) w.putLine(vars[vi], li, v[vi]);
+		}
+		w.close();
+	}
+};
+
+};//endname space
@@ -0,0 +1,176 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+// How a window is filled beyond the ends of a line
+enum class eWindowPadding {
+	NULLS,//NaN
+	EDGE,//repeat the first or last sample
+	REFLECT//mirror about the first or last sample, eg -1 -> 1
+};
+
+// Streams each sample of a line together with its +/- halfwidth neighbours in the same line.
+// Each variable is read in blocks of whole chunks (see GFile::copy_block_rows()) into a ring
+// buffer of block + 2*halfwidth + 1 samples, so memory use does not depend on the line length.
+// Windows never cross into the neighbouring lines, beyond the line ends they are padded.
+// Values are double with nulls as NaN.
+//
+//   GWindowReader w(file, { "easting", "em" }, 5, eWindowPadding::REFLECT);
+//   for (bool ok = w.seek(li); ok; ok = w.next()) {
+//       double e = w(0, -1);//easting of the previous sample
+//       double z = w(1, 2, bi);//band bi of em two samples ahead
+//   }
+class GWindowReader {
+
+private:
+
+	class cInput {
+	public:
+		GSampleVar var;
+		size_t nbands = 1;
+		std::vector<double> ring;//capacity samples x nbands
+		std::vector<double> block;
+
+		cInput(const GSampleVar& v) : var(v) {}
+	};
+
+	GFile& File;
+	std::vector<cInput> Inputs;
+	size_t HalfWidth;
+	eWindowPadding Padding;
+	size_t BlockSamples = 1;//samples read at a time, the same for every input so they stay in step
+	size_t Capacity = 0;//samples held by each ring
+
+	size_t LineIndex = 0;
+	size_t LineStart = 0;//first sample of the line in the file
+	size_t NSamples = 0;
+	size_t Centre = 0;
+	size_t Loaded = 0;//samples [0, Loaded) of the line have been read, the last Capacity of them are held
+
+	//Read blocks until the window about the centre is held
+	void load() {
+		const size_t need = std::min(NSamples, Centre + HalfWidth + 1);
+		while (Loaded < need) {
+			const size_t n = std::min(BlockSamples, NSamples - Loaded);
+			for (cInput& in : Inputs) {
+				std::vector<size_t> start = { LineStart + Loaded };
+				std::vector<size_t> count = { n };
+				if (in.var.getDimCount() > 1) {
+					start.push_back(0);
+					count.push_back(in.nbands);
+				}
+				in.block.resize(n * in.nbands);
+				in.var.getVarMapped(start, count, in.block.data(), std::numeric_limits<double>::quiet_NaN());
+				for (size_t k = 0; k < n; k++) {
+					const size_t slot = ((Loaded + k) % Capacity) * in.nbands;
+					std::copy(in.block.begin() + k * in.nbands, in.block.begin() + (k + 1) * in.nbands, in.ring.begin() + slot);
+				}
+			}
+			Loaded += n;
+		}
+	}
+
+	//Sample of the line that stands in for centre + offset, false if it is padded with nulls
+	bool resolve(const long offset, size_t& si) const {
+		const long n = (long)NSamples;
+		long s = (long)Centre + offset;
+		if (s >= 0 && s < n) {
+			si = (size_t)s;
+			return true;
+		}
+		if (Padding == eWindowPadding::NULLS) return false;
+		if (Padding == eWindowPadding::REFLECT) s = s < 0 ? -s : 2 * (n - 1) - s;
+		si = (size_t)std::max(0L, std::min(n - 1, s));
+		return true;
+	}
+
+public:
+
+	//blocksamples = 0 reads whole chunks of about 1MB at a time
+	GWindowReader(GFile& file, const std::vector<std::string>& varnames, const size_t halfwidth,
+		const eWindowPadding padding = eWindowPadding::EDGE, const size_t blocksamples = 0)
+		: File(file), HalfWidth(halfwidth), Padding(padding)
+	{
+		BlockSamples = blocksamples;
+		for (const std::string& name : varnames) {
+			GSampleVar v = File.getSampleVar(name);
+			if (v.isNull() || v.isSampleVar() == false || v.getDimCount() > 2) {
+				std::string msg = _SRC_ + strprint("\nVariable (%s) is not a single or multiband sample variable\n", name.c_str());
+				throw(std::exception(msg.c_str()));
+			}
+			Inputs.push_back(cInput(v));
+			Inputs.back().nbands = v.elementspersample();
+			if (blocksamples == 0) BlockSamples = std::max(BlockSamples, GFile::copy_block_rows(v));
+		}
+
+		BlockSamples = std::max((size_t)1, BlockSamples);
+		Capacity = BlockSamples + 2 * HalfWidth + 1;
+		for (cInput& in : Inputs) in.ring.resize(Capacity * in.nbands);
+	}
+
+	//Start at the first sample of a line, false if the line has no samples
+	bool seek(const size_t lineindex) {
+		LineIndex = lineindex;
+		LineStart = File.get_line_index_start(lineindex);
+		NSamples = File.nlinesamples(lineindex);
+		Centre = 0;
+		Loaded = 0;
+		if (NSamples == 0) return false;
+		load();
+		return true;
+	}
+
+	//Move to the next sample, false at the end of the line
+	bool next() {
+		if (Centre + 1 >= NSamples) return false;
+		Centre++;
+		load();
+		return true;
+	}
+
+	size_t nvars() const { return Inputs.size(); }
+	size_t nbands(const size_t vi) const { return Inputs[vi].nbands; }
+	size_t halfwidth() const { return HalfWidth; }
+	size_t lineindex() const { return LineIndex; }
+	size_t nsamples() const { return NSamples; }
+
+	//Index of the centre sample within the line
+	size_t sample() const { return Centre; }
+
+	//True if centre + offset lies within the line
+	bool inside(const long offset) const {
+		const long s = (long)Centre + offset;
+		return s >= 0 && s < (long)NSamples;
+	}
+
+	//Value of band bi of variable vi at centre + offset, |offset| <= halfwidth
+	double operator()(const size_t vi, const long offset, const size_t bi = 0) const {
+		if ((size_t)std::labs(offset) > HalfWidth) {
+			std::string msg = _SRC_ + strprint("\nWindow offset (%ld) is beyond the half width (%zu)\n", offset, HalfWidth);
+			throw(std::exception(msg.c_str()));
+		}
+		size_t si;
+		if (resolve(offset, si) == false) return std::numeric_limits<double>::quiet_NaN();
+		const cInput& in = Inputs[vi];
+		return in.ring[(si % Capacity) * in.nbands + bi];
+	}
+
+	//All bands of variable vi at centre + offset
+	void get(const size_t vi, const long offset, std::vector<double>& vals) const {
+		const size_t nb = Inputs[vi].nbands;
+		vals.resize(nb);
+		for (size_t bi = 0; bi < nb; bi++) vals[bi] = (*this)(vi, offset, bi);
+	}
+};
+
+};//endname space
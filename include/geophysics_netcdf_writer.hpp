@@ -0,0 +1,388 @@
+/*
+This source code file is licensed under the GNU GPL Version 2.0 Licence by the following copyright holder:
+Crown Copyright Commonwealth of Australia (Geoscience Australia) 2016.
+The GNU GPL 2.0 licence is available at: http://www.gnu.org/licenses/gpl-2.0.html. If you require a paper copy of the GNU GPL 2.0 Licence, please write to Free Software Foundation, Inc. 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+Author: Ross C. Brodie, Geoscience Australia.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include "geophysics_netcdf.hpp"
+
+namespace GeophysicsNetCDF {
+
+// Write-behind buffer for the sample variables of one GFile.
+// Writes are collected in memory in blocks that span whole chunks of the
+// point dimension. A block is handed to a background thread and written
+// with a single netCDF call as soon as every element in it has been
+// written, so each compressed chunk is encoded once instead of per call.
+// flush() writes any partially filled blocks and waits until all pending
+// writes are on disk, close() (or the destructor) also stops the thread.
+// Values are held in the variable's own type, so 64 bit integers keep full precision.
+// While the writer is active make other netCDF calls on the same file after flush().
+// Do not hold netcdf_mutex() while calling the put functions, when the queue is full
+// they wait for the background thread, which needs that lock to write.
+class GBufferedWriter {
+
+private:
+
+	class cBlock {
+	public:
+		size_t firstrow = 0;
+		size_t nrows = 0;
+		size_t nwritten = 0;
+		std::vector<uint8_t> data;//values in the variable's type
+		std::vector<uint8_t> written;//one flag per element
+	};
+
+	class cVarBuffer {
+	public:
+		NcVar  var;
+		nc_type type = NC_DOUBLE;
+		size_t typesize = sizeof(double);
+		std::vector<size_t> dimsizes;//sizes of the non-point dimensions
+		size_t rowsize = 1;//elements per sample
+		size_t blockrows = 1;
+		size_t nrowstotal = 0;
+		std::map<size_t, cBlock> blocks;//keyed by block number
+		cBlock* current = nullptr;//most recently used block
+		size_t currentbn = 0;
+	};
+
+	class cPending {
+	public:
+		const cVarBuffer* buffer = nullptr;
+		cBlock block;
+	};
+
+	GFile& File;
+	std::map<int, cVarBuffer> Buffers;//keyed by netCDF variable id
+	size_t MaxQueued;
+
+	std::mutex Mutex;
+	std::condition_variable Ready;
+	std::condition_variable Done;
+	std::deque<cPending> Queue;
+	size_t Busy = 0;//blocks queued or being written
+	bool Stop = false;
+	std::exception_ptr Error;
+	std::thread Worker;
+
+	cVarBuffer& buffer(const NcVar& var) {
+		auto it = Buffers.find(var.getId());
+		if (it != Buffers.end()) return it->second;
+
+		//The background thread may be writing
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		if (var.isNull() || var.getDimCount() == 0 || var.getDim(0).getName() != DN_POINT) {
+			std::string msg = _SRC_ + strprint("\nAttempt to use a buffered write on a variable that is not a sample variable\n");
+			throw(std::exception(msg.c_str()));
+		}
+
+		const nc_type type = var.getType().getId();
+		if (type < NC_BYTE || type > NC_UINT64 || type == NC_CHAR) {
+			std::string msg = _SRC_ + strprint("\nAttempt to use a buffered write on variable (%s) of unsupported type %s\n", var.getName().c_str(), var.getType().getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+
+		cVarBuffer& b = Buffers[var.getId()];
+		b.var = var;
+		b.type = type;
+		b.typesize = var.getType().getSize();
+		std::vector<NcDim> dims = var.getDims();
+		b.nrowstotal = dims[0].getSize();
+		for (size_t i = 1; i < dims.size(); i++) {
+			b.dimsizes.push_back(dims[i].getSize());
+			b.rowsize *= dims[i].getSize();
+		}
+		b.blockrows = GFile::point_chunk_size(var);
+		return b;
+	}
+
+	template<typename S, typename T>
+	static void store(uint8_t* p, const T& value) {
+		const S v = static_cast<S>(value);
+		std::memcpy(p, &v, sizeof(S));
+	}
+
+	//Convert value to the variable's type
+	template<typename T>
+	static void store(const nc_type type, uint8_t* p, const T& value) {
+		switch (type) {
+		case NC_BYTE: store<int8_t>(p, value); break;
+		case NC_UBYTE: store<uint8_t>(p, value); break;
+		case NC_SHORT: store<short>(p, value); break;
+		case NC_USHORT: store<unsigned short>(p, value); break;
+		case NC_INT: store<int>(p, value); break;
+		case NC_UINT: store<unsigned int>(p, value); break;
+		case NC_INT64: store<long long>(p, value); break;
+		case NC_UINT64: store<unsigned long long>(p, value); break;
+		case NC_FLOAT: store<float>(p, value); break;
+		default: store<double>(p, value); break;
+		}
+	}
+
+	template<typename T>
+	void set(cVarBuffer& b, const size_t row, const size_t element, const T& value) {
+		const size_t bn = row / b.blockrows;
+		if (b.current == nullptr || b.currentbn != bn) {
+			auto it = b.blocks.find(bn);
+			if (it == b.blocks.end()) {
+				cBlock blk;
+				blk.firstrow = bn * b.blockrows;
+				blk.nrows = std::min(b.blockrows, b.nrowstotal - blk.firstrow);
+				blk.data.resize(blk.nrows * b.rowsize * b.typesize);
+				blk.written.resize(blk.nrows * b.rowsize, 0);
+				it = b.blocks.emplace(bn, std::move(blk)).first;
+			}
+			b.current = &it->second;
+			b.currentbn = bn;
+		}
+
+		cBlock& blk = *b.current;
+		const size_t k = (row - blk.firstrow) * b.rowsize + element;
+		store(b.type, &blk.data[k * b.typesize], value);
+		if (blk.written[k] == 0) {
+			blk.written[k] = 1;
+			blk.nwritten++;
+		}
+
+		if (blk.nwritten == blk.written.size()) {
+			enqueue(b, std::move(blk));
+			b.blocks.erase(bn);
+			b.current = nullptr;
+		}
+	}
+
+	void enqueue(const cVarBuffer& b, cBlock&& blk) {
+		std::unique_lock<std::mutex> lock(Mutex);
+		Done.wait(lock, [this] { return Queue.size() < MaxQueued || Error; });
+		rethrow_locked();
+		cPending p;
+		p.buffer = &b;
+		p.block = std::move(blk);
+		Queue.push_back(std::move(p));
+		Busy++;
+		Ready.notify_one();
+	}
+
+	void rethrow_locked() {
+		if (Error) {
+			std::exception_ptr e = Error;
+			Error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	void run() {
+		for (;;) {
+			cPending p;
+			{
+				std::unique_lock<std::mutex> lock(Mutex);
+				Ready.wait(lock, [this] { return Stop || Queue.size() > 0; });
+				if (Queue.size() == 0) return;
+				p = std::move(Queue.front());
+				Queue.pop_front();
+			}
+
+			try {
+				write(*p.buffer, p.block);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(Mutex);
+				if (!Error) Error = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Busy--;
+			}
+			Done.notify_all();
+		}
+	}
+
+	static void write(const cVarBuffer& b, const cBlock& blk) {
+		std::lock_guard<std::recursive_mutex> lock(netcdf_mutex());
+		const size_t nd = b.dimsizes.size() + 1;
+		std::vector<size_t> start(nd, 0);
+		std::vector<size_t> count(nd);
+		for (size_t i = 1; i < nd; i++) count[i] = b.dimsizes[i - 1];
+
+		//The normal case, the whole block in one call
+		if (blk.nwritten == blk.written.size()) {
+			start[0] = blk.firstrow;
+			count[0] = blk.nrows;
+			b.var.putVar(start, count, (const void*)blk.data.data());
+			return;
+		}
+
+		//A partially filled block from flush(), write runs of whole rows and the written parts of other rows
+		size_t r = 0;
+		while (r < blk.nrows) {
+			size_t re = r;
+			while (re < blk.nrows && row_complete(b, blk, re)) re++;
+			if (re > r) {
+				start[0] = blk.firstrow + r;
+				count[0] = re - r;
+				b.var.putVar(start, count, (const void*)&blk.data[r * b.rowsize * b.typesize]);
+				r = re;
+				continue;
+			}
+			write_partial_row(b, blk, r);
+			r++;
+		}
+	}
+
+	static bool row_complete(const cVarBuffer& b, const cBlock& blk, const size_t r) {
+		const uint8_t* w = &blk.written[r * b.rowsize];
+		for (size_t e = 0; e < b.rowsize; e++) {
+			if (w[e] == 0) return false;
+		}
+		return true;
+	}
+
+	static void write_partial_row(const cVarBuffer& b, const cBlock& blk, const size_t r) {
+		const size_t nd = b.dimsizes.size() + 1;
+		const size_t k0 = r * b.rowsize;
+		std::vector<size_t> start(nd, 0);
+		std::vector<size_t> count(nd, 1);
+		start[0] = blk.firstrow + r;
+		for (size_t e = 0; e < b.rowsize; e++) {
+			if (blk.written[k0 + e] == 0) continue;
+			if (nd == 2) {
+				size_t ee = e;
+				while (ee < b.rowsize && blk.written[k0 + ee]) ee++;
+				start[1] = e;
+				count[1] = ee - e;
+				b.var.putVar(start, count, (const void*)&blk.data[(k0 + e) * b.typesize]);
+				e = ee;
+			}
+			else {
+				size_t rem = e;
+				for (size_t i = nd - 1; i >= 1; i--) {
+					start[i] = rem % b.dimsizes[i - 1];
+					rem /= b.dimsizes[i - 1];
+				}
+				b.var.putVar(start, count, (const void*)&blk.data[(k0 + e) * b.typesize]);
+			}
+		}
+	}
+
+public:
+
+	GBufferedWriter(GFile& file, const size_t maxqueuedblocks = 64)
+		: File(file), MaxQueued(std::max((size_t)1, maxqueuedblocks))
+	{
+		Worker = std::thread(&GBufferedWriter::run, this);
+	}
+
+	//Do not allow copying
+	GBufferedWriter(const GBufferedWriter& rhs) = delete;
+	GBufferedWriter& operator=(const GBufferedWriter& rhs) = delete;
+
+	~GBufferedWriter() {
+		try {
+			close();
+		}
+		catch (...) {
+		}
+	}
+
+	template<typename T>
+	void putRecord(const GSampleVar& var, const size_t& record, const T& v) {
+		cVarBuffer& b = buffer(var);
+		set(b, record, 0, v);
+	}
+
+	template<typename T>
+	void putRecord(const GSampleVar& var, const size_t& record, const std::vector<T>& v) {
+		cVarBuffer& b = buffer(var);
+		if (v.size() != b.rowsize) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write record of variable (%s) with non-matching size\n", var.getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		for (size_t e = 0; e < b.rowsize; e++) set(b, record, e, v[e]);
+	}
+
+	template<typename T>
+	void putPoint(const GSampleVar& var, const size_t& pointindex, const std::vector<T>& v) {
+		putRecord(var, pointindex, v);
+	}
+
+	template<typename T>
+	void putLine(const GSampleVar& var, const size_t& lineindex, const std::vector<T>& vals) {
+		cVarBuffer& b = buffer(var);
+		const size_t start = var.line_index_start(lineindex);
+		const size_t ns = var.line_index_count(lineindex);
+		if (vals.size() != ns * b.rowsize) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write line of variable (%s) with non-matching size\n", var.getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		size_t k = 0;
+		for (size_t si = 0; si < ns; si++) {
+			for (size_t e = 0; e < b.rowsize; e++) {
+				set(b, start + si, e, vals[k++]);
+			}
+		}
+	}
+
+	template<typename T>
+	void putLineBand(const GSampleVar& var, const size_t& lineindex, const size_t& bandindex, const std::vector<T>& vals) {
+		cVarBuffer& b = buffer(var);
+		if (b.dimsizes.size() > 1) {
+			std::string msg = _SRC_ + strprint("\nAttempt to use putLineBand() to write to a variable with more than 2 dimensions\n");
+			throw(std::exception(msg.c_str()));
+		}
+		const size_t start = var.line_index_start(lineindex);
+		const size_t ns = var.line_index_count(lineindex);
+		if (vals.size() != ns) {
+			std::string msg = _SRC_ + strprint("\nAttempt to write line/band of variable (%s) with non-matching size\n", var.getName().c_str());
+			throw(std::exception(msg.c_str()));
+		}
+		for (size_t si = 0; si < ns; si++) {
+			set(b, start + si, bandindex, vals[si]);
+		}
+	}
+
+	//Queue all partially filled blocks and wait until every pending write is complete
+	void flush() {
+		for (auto& it : Buffers) {
+			cVarBuffer& b = it.second;
+			for (auto& bit : b.blocks) {
+				enqueue(b, std::move(bit.second));
+			}
+			b.blocks.clear();
+			b.current = nullptr;
+		}
+
+		std::unique_lock<std::mutex> lock(Mutex);
+		Done.wait(lock, [this] { return Busy == 0; });
+		rethrow_locked();
+	}
+
+	//Flush and stop the background thread, no further writes may be made
+	void close() {
+		if (Worker.joinable() == false) return;
+		std::exception_ptr e;
+		try {
+			flush();
+		}
+		catch (...) {
+			e = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Stop = true;
+		}
+		Ready.notify_all();
+		Worker.join();
+		if (e) std::rethrow_exception(e);
+	}
+
+};
+
+};//endname space